@@ -43,6 +43,24 @@ struct Material {
         , specular(0.0f)
     {}
 
+    bool operator==(const Material& other) const {
+        return type == other.type
+            && albedo.r == other.albedo.r && albedo.g == other.albedo.g && albedo.b == other.albedo.b
+            && emission.r == other.emission.r && emission.g == other.emission.g && emission.b == other.emission.b
+            && roughness == other.roughness
+            && ior == other.ior
+            && chequerboard_colour_a.r == other.chequerboard_colour_a.r
+            && chequerboard_colour_a.g == other.chequerboard_colour_a.g
+            && chequerboard_colour_a.b == other.chequerboard_colour_a.b
+            && chequerboard_colour_b.r == other.chequerboard_colour_b.r
+            && chequerboard_colour_b.g == other.chequerboard_colour_b.g
+            && chequerboard_colour_b.b == other.chequerboard_colour_b.b
+            && chequerboard_scale == other.chequerboard_scale
+            && metallic == other.metallic
+            && specular == other.specular;
+    }
+    bool operator!=(const Material& other) const { return !(*this == other); }
+
     //TEMP factory methods for common mats
     static Material lambertian(const Colour& _albedo) {
         Material mat;
@@ -162,9 +162,9 @@ void PropertiesPanel::create_transform_controls(SceneNode* node, QVBoxLayout* la
     grid->setSpacing(4);
     grid->setContentsMargins(7,10,7,7);
 
-    add_vec3_row("Position", node->transform.position, -100.0f, 100.0f, 0.01f, grid, 0);
-    add_vec3_row("Rotation", node->transform.rotation, -180.0f, 180.0f, 0.1f, grid, 1);
-    add_vec3_row("Scale", node->transform.scale, 0.01f, 10.0f, 0.01f, grid, 2);
+    add_vec3_row("Position", node->transform.position, -100.0f, 100.0f, 0.01f, grid, 0, NodeChange::Transform);
+    add_vec3_row("Rotation", node->transform.rotation, -180.0f, 180.0f, 0.1f, grid, 1, NodeChange::Transform);
+    add_vec3_row("Scale", node->transform.scale, 0.01f, 10.0f, 0.01f, grid, 2, NodeChange::Transform);
     //TEMP no rot until we support it
 
     layout->addWidget(transform_group);
@@ -209,6 +209,7 @@ void PropertiesPanel::create_material_controls(SceneNode* node, QVBoxLayout* lay
     connect(type_combo, QOverload<int>::of(&QComboBox::currentIndexChanged), 
         [node, this](int index) {
             node->material.type = static_cast<MaterialType>(index);
+            node->mark_dirty(NodeChange::Material);
             // doing it this way to defer ui rebuild until after signal completes, 
             // otherwise was getting deleted memory reads from QComboBox being destroyed whist
             // still in its signal handler.  bc of rebuild_ui happening deleting all widgets
@@ -221,35 +222,36 @@ void PropertiesPanel::create_material_controls(SceneNode* node, QVBoxLayout* lay
                         viewport->update();
                     }
                 }
+                emit properties_changed();
             }, Qt::QueuedConnection);
         });
     grid->addWidget(type_combo, row++, 1, 1, 3);
 
     // albedo (for most material types)
     if (node->material.type != MaterialType::Dielectric) {
-        add_colour_row("Albedo", node->material.albedo, 0.0f, 1.0f, 0.01f, grid, row++);
+        add_colour_row("Albedo", node->material.albedo, 0.0f, 1.0f, 0.01f, grid, row++, NodeChange::Material);
     }
 
     // emission
     if (node->material.type == MaterialType::Emissive) {
-        add_colour_row("Emission", node->material.emission, 0.0f, 50.0f, 0.1f, grid, row++);
+        add_colour_row("Emission", node->material.emission, 0.0f, 50.0f, 0.1f, grid, row++, NodeChange::Material);
     }
 
     // metal roughness
     if (node->material.type == MaterialType::Metal) {
-        add_float_row("Roughness", node->material.roughness, 0.0f, 1.0f, 0.01f, grid, row++);
+        add_float_row("Roughness", node->material.roughness, 0.0f, 1.0f, 0.01f, grid, row++, NodeChange::Material);
     }
 
     // IOR
     if (node->material.type == MaterialType::Dielectric) {
-        add_float_row("IOR", node->material.ior, 1.0f, 3.0f, 0.01f, grid, row++);
+        add_float_row("IOR", node->material.ior, 1.0f, 3.0f, 0.01f, grid, row++, NodeChange::Material);
     }
 
     // chequerboard specific
     if (node->material.type == MaterialType::Chequerboard) {
-        add_colour_row("Colour A", node->material.chequerboard_colour_a, 0.0f, 1.0f, 0.01f, grid, row++);
-        add_colour_row("Colour B", node->material.chequerboard_colour_b, 0.0f, 1.0f, 0.01f, grid, row++);
-        add_float_row("Scale", node->material.chequerboard_scale, 0.1f, 20.0f, 0.1f, grid, row++);
+        add_colour_row("Colour A", node->material.chequerboard_colour_a, 0.0f, 1.0f, 0.01f, grid, row++, NodeChange::Material);
+        add_colour_row("Colour B", node->material.chequerboard_colour_b, 0.0f, 1.0f, 0.01f, grid, row++, NodeChange::Material);
+        add_float_row("Scale", node->material.chequerboard_scale, 0.1f, 20.0f, 0.1f, grid, row++, NodeChange::Material);
     }
 
     layout->addWidget(material_group);
@@ -286,8 +288,8 @@ void PropertiesPanel::create_light_controls(SceneNode* node, QVBoxLayout* layout
     QLabel* type_label = new QLabel("Type: " + type_str);
     grid->addWidget(type_label, 0, 0, 1, 4);
 
-    add_colour_row("Colour", node->light->colour, 0.0f, 50.0f, 0.1f, grid, 1);
-    add_float_row("Intensity", node->light->intensity, 0.0f, 100.0f, 0.1f, grid, 2);
+    add_colour_row("Colour", node->light->colour, 0.0f, 50.0f, 0.1f, grid, 1, NodeChange::Material);
+    add_float_row("Intensity", node->light->intensity, 0.0f, 100.0f, 0.1f, grid, 2, NodeChange::Material);
 
     layout->addWidget(light_group);
 }
@@ -362,6 +364,7 @@ void PropertiesPanel::create_camera_controls(QVBoxLayout* layout)
                 viewport->update();
             }
         }
+        emit camera_properties_changed();
     }));
 
     DragSpinBox* target_y = new DragSpinBox(target_wrapper);
@@ -378,6 +381,7 @@ void PropertiesPanel::create_camera_controls(QVBoxLayout* layout)
                 viewport->update();
             }
         }
+        emit camera_properties_changed();
     }));
 
     DragSpinBox* target_z = new DragSpinBox(target_wrapper);
@@ -394,6 +398,7 @@ void PropertiesPanel::create_camera_controls(QVBoxLayout* layout)
                 viewport->update();
             }
         }
+        emit camera_properties_changed();
     }));
 
     BorderOverlay* target_overlay = new BorderOverlay(target_wrapper);
@@ -420,6 +425,7 @@ void PropertiesPanel::create_camera_controls(QVBoxLayout* layout)
                 viewport->update();
             }
         }
+        emit camera_properties_changed();
     }));
     grid->addWidget(dist_spin, row++, 1, 1, 3);
 
@@ -443,6 +449,7 @@ void PropertiesPanel::create_camera_controls(QVBoxLayout* layout)
                 viewport->update();
             }
         }
+        emit camera_properties_changed();
     }));
     grid->addWidget(yaw_spin, row++, 1, 1, 3);
 
@@ -466,6 +473,7 @@ void PropertiesPanel::create_camera_controls(QVBoxLayout* layout)
                 viewport->update();
             }
         }
+        emit camera_properties_changed();
         }));
     grid->addWidget(pitch_spin, row++, 1, 1, 3);
 
@@ -485,13 +493,14 @@ void PropertiesPanel::create_camera_controls(QVBoxLayout* layout)
                 viewport->update();
             }
         }
+        emit camera_properties_changed();
         }));
     grid->addWidget(fov_spin, row++, 1, 1, 3);
 
     layout->addWidget(camera_group);
 }
 
-void PropertiesPanel::add_vec3_row(const QString& label, Vec3& vec, float min_val, float max_val, float speed, QGridLayout* grid, int row) {
+void PropertiesPanel::add_vec3_row(const QString& label, Vec3& vec, float min_val, float max_val, float speed, QGridLayout* grid, int row, NodeChange change) {
     QLabel* label_widget = new QLabel(label);
     label_widget->setMinimumWidth(50);
     grid->addWidget(label_widget, row, 0);
@@ -506,8 +515,9 @@ void PropertiesPanel::add_vec3_row(const QString& label, Vec3& vec, float min_va
     x_box->set_speed(speed);
     x_box->set_value(vec.x);
     x_box->set_letter(SpinBoxLetter::X);
-    connect(x_box, &DragSpinBox::value_changed, [&vec, this](float value) {
+    connect(x_box, &DragSpinBox::value_changed, [&vec, change, this](float value) {
         vec.x = value;
+        if (current_node) current_node->mark_dirty(change);
         // trigger viewport update
         if (auto* main_win = qobject_cast<QMainWindow*>(window())) {
             if (auto* viewport = main_win->centralWidget()) {
@@ -522,8 +532,9 @@ void PropertiesPanel::add_vec3_row(const QString& label, Vec3& vec, float min_va
     y_box->set_speed(speed);
     y_box->set_value(vec.y);
     y_box->set_letter(SpinBoxLetter::Y);
-    connect(y_box, &DragSpinBox::value_changed, [&vec, this](float value) {
+    connect(y_box, &DragSpinBox::value_changed, [&vec, change, this](float value) {
         vec.y = value;
+        if (current_node) current_node->mark_dirty(change);
         if (auto* main_win = qobject_cast<QMainWindow*>(window())) {
             if (auto* viewport = main_win->centralWidget()) {
                 viewport->update();
@@ -537,8 +548,9 @@ void PropertiesPanel::add_vec3_row(const QString& label, Vec3& vec, float min_va
     z_box->set_speed(speed);
     z_box->set_value(vec.z);
     z_box->set_letter(SpinBoxLetter::Z);
-    connect(z_box, &DragSpinBox::value_changed, [&vec, this](float value) {
+    connect(z_box, &DragSpinBox::value_changed, [&vec, change, this](float value) {
         vec.z = value;
+        if (current_node) current_node->mark_dirty(change);
         if (auto* main_win = qobject_cast<QMainWindow*>(window())) {
             if (auto* viewport = main_win->centralWidget()) {
                 viewport->update();
@@ -553,7 +565,7 @@ void PropertiesPanel::add_vec3_row(const QString& label, Vec3& vec, float min_va
     grid->addWidget(wrapper, row, 1, 1, 3);
 }
 
-void PropertiesPanel::add_colour_row(const QString& label, Colour& colour, float min_val, float max_val, float speed, QGridLayout* grid, int row) {
+void PropertiesPanel::add_colour_row(const QString& label, Colour& colour, float min_val, float max_val, float speed, QGridLayout* grid, int row, NodeChange change) {
     QLabel* label_widget = new QLabel(label);
     label_widget->setMinimumWidth(50);
     grid->addWidget(label_widget, row, 0);
@@ -568,8 +580,9 @@ void PropertiesPanel::add_colour_row(const QString& label, Colour& colour, float
     r_box->set_speed(speed);
     r_box->set_value(colour.r);
     r_box->set_letter(SpinBoxLetter::R);
-    connect(r_box, &DragSpinBox::value_changed, [&colour, this](float value) {
+    connect(r_box, &DragSpinBox::value_changed, [&colour, change, this](float value) {
         colour.r = value;
+        if (current_node) current_node->mark_dirty(change);
         if (auto* main_win = qobject_cast<QMainWindow*>(window())) {
             if (auto* viewport = main_win->centralWidget()) {
                 viewport->update();
@@ -583,8 +596,9 @@ void PropertiesPanel::add_colour_row(const QString& label, Colour& colour, float
     g_box->set_speed(speed);
     g_box->set_value(colour.g);
     g_box->set_letter(SpinBoxLetter::G);
-    connect(g_box, &DragSpinBox::value_changed, [&colour, this](float value) {
+    connect(g_box, &DragSpinBox::value_changed, [&colour, change, this](float value) {
         colour.g = value;
+        if (current_node) current_node->mark_dirty(change);
         if (auto* main_win = qobject_cast<QMainWindow*>(window())) {
             if (auto* viewport = main_win->centralWidget()) {
                 viewport->update();
@@ -598,8 +612,9 @@ void PropertiesPanel::add_colour_row(const QString& label, Colour& colour, float
     b_box->set_speed(speed);
     b_box->set_value(colour.b);
     b_box->set_letter(SpinBoxLetter::B);
-    connect(b_box, &DragSpinBox::value_changed, [&colour, this](float value) {
+    connect(b_box, &DragSpinBox::value_changed, [&colour, change, this](float value) {
         colour.b = value;
+        if (current_node) current_node->mark_dirty(change);
         if (auto* main_win = qobject_cast<QMainWindow*>(window())) {
             if (auto* viewport = main_win->centralWidget()) {
                 viewport->update();
@@ -614,7 +629,7 @@ void PropertiesPanel::add_colour_row(const QString& label, Colour& colour, float
     grid->addWidget(wrapper, row, 1, 1, 3);
 }
 
-void PropertiesPanel::add_float_row(const QString& label, float& value, float min_val, float max_val, float speed, QGridLayout* grid, int row) {
+void PropertiesPanel::add_float_row(const QString& label, float& value, float min_val, float max_val, float speed, QGridLayout* grid, int row, NodeChange change) {
     QLabel* label_widget = new QLabel(label);
     label_widget->setMinimumWidth(60);
     grid->addWidget(label_widget, row, 0);
@@ -623,8 +638,9 @@ void PropertiesPanel::add_float_row(const QString& label, float& value, float mi
     spin_box->set_range(min_val, max_val);
     spin_box->set_speed(speed);
     spin_box->set_value(value);
-    connect(spin_box, &DragSpinBox::value_changed, [&value, this](float new_value) {
+    connect(spin_box, &DragSpinBox::value_changed, [&value, change, this](float new_value) {
         value = new_value;
+        if (current_node) current_node->mark_dirty(change);
         if (auto* main_win = qobject_cast<QMainWindow*>(window())) {
             if (auto* viewport = main_win->centralWidget()) {
                 viewport->update();
@@ -88,8 +88,8 @@ private slots:
     void on_selection_changed(SceneNode* node);
 
 signals:
-    void properties_changed(); // visible/locked changed
-    void camera_properties_changed();
+    void properties_changed(); // visible/locked or other node properties changed
+    void camera_properties_changed(); // viewport camera edited from the panel
 
 private:
     void rebuild_ui(SceneNode* node);
@@ -98,11 +98,12 @@ private:
     void create_light_controls(SceneNode* node, QVBoxLayout* layout);
     void create_camera_controls(QVBoxLayout* layout);
 
-    void add_vec3_row(const QString& label, Vec3& vec, float min_val, float max_val, float speed, QGridLayout* grid, int row);
+    // rows edit the value in place and mark current_node dirty with change
+    void add_vec3_row(const QString& label, Vec3& vec, float min_val, float max_val, float speed, QGridLayout* grid, int row, NodeChange change);
 
-    void add_colour_row(const QString& label, Colour& colour, float min_val, float max_val, float speed, QGridLayout* grid, int row);
+    void add_colour_row(const QString& label, Colour& colour, float min_val, float max_val, float speed, QGridLayout* grid, int row, NodeChange change);
 
-    void add_float_row(const QString& label, float& value, float min_val, float max_val, float speed, QGridLayout* grid, int row);
+    void add_float_row(const QString& label, float& value, float min_val, float max_val, float speed, QGridLayout* grid, int row, NodeChange change);
 
     SelectionHandler* selection_handler;
     Camera* camera;
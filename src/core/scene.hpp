@@ -6,6 +6,7 @@
 #include "core/geometry.hpp"
 #include "core/material.hpp"
 #include "core/sky.hpp"
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <string>
@@ -43,6 +44,14 @@ enum class NodeType {
                   // ugly comma-prefixed list I think
 };
 
+// what an edit to a node touched, see SceneNode::mark_dirty
+enum class NodeChange {
+    Transform,
+    Material, // a light's colour and intensity count as its material
+    Geometry, // the geo or primitive's shape, in place
+    NodeChangeCount
+};
+
 enum class LightType {
     Point,
     Directional,
@@ -68,6 +77,7 @@ struct Light {
 
 class SceneNode {
 public:
+    uint64_t id; // unique for the run, unlike the address which a new node can reuse
     std::string name;
     Transform transform;
     NodeType node_type;
@@ -76,7 +86,10 @@ public:
 
     // will be set depending on node_type between:
     std::unique_ptr<Primitive> primitive;
-    std::unique_ptr<Geo> geo;
+    // shared so several nodes can place the same mesh (see
+    // SceneOperations::instance_node), which the raytracer then instances
+    // instead of copying.  editing a shared geo's verts edits every placement
+    std::shared_ptr<Geo> geo;
 
     Material material;
 
@@ -88,8 +101,18 @@ public:
     std::vector<std::unique_ptr<SceneNode>> children;
     SceneNode* parent;
 
+    // dirty tracking.  an edit bumps a counter per kind of change rather than
+    // setting a flag, so any number of converted copies (the raytracer's
+    // RenderScene) can each tell what's changed since they last looked, and
+    // nobody has to clear anything.  adding, removing or hiding nodes, or
+    // swapping in a new geo, is picked up without marking
+    uint32_t revisions[int(NodeChange::NodeChangeCount)] = {};
+
+    void mark_dirty(NodeChange change) { revisions[int(change)]++; }
+
     explicit SceneNode(const std::string& _name = "Node")
-        : name(_name)
+        : id(next_id++)
+        , name(_name)
         , node_type(NodeType::Empty)
         , parent(nullptr)
         , visible(true)
@@ -112,6 +135,9 @@ public:
         }
         return pos;
     }
+
+private:
+    static inline uint64_t next_id = 1;
 };
 
 // editor-facing scene
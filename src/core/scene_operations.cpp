@@ -82,6 +82,20 @@ std::unique_ptr<SceneNode> SceneOperations::create_mesh(const std::string& name)
     return node;
 }
 
+SceneNode* SceneOperations::instance_node(SceneNode* node) {
+    if (!node || !node->parent || node->node_type != NodeType::Mesh || !node->geo) return nullptr;
+
+    auto instance = std::make_unique<SceneNode>(node->name + " Instance");
+    instance->node_type = NodeType::Mesh;
+    instance->geo = node->geo;
+    instance->material = node->material;
+    instance->transform = node->transform;
+
+    SceneNode* instance_ptr = instance.get();
+    node->parent->add_child(std::move(instance));
+    return instance_ptr;
+}
+
 std::unique_ptr<SceneNode> SceneOperations::create_point_light(const std::string& name) {
     auto node = std::make_unique<SceneNode>(name);
     node->node_type = NodeType::Light;
@@ -24,6 +24,11 @@ public:
     static std::unique_ptr<SceneNode> create_point_light(const std::string& name = "Point Light");
     static std::unique_ptr<SceneNode> create_area_light(const std::string& name = "Area Light");
 
+    // another placement of a mesh node, added next to it.  it shares the geo
+    // rather than copying it, so the raytracer instances it, and component edits
+    // to either show in both.  nullptr unless node is a mesh with a parent
+    static SceneNode* instance_node(SceneNode* node);
+
     //io
     static std::unique_ptr<SceneNode> import_mesh_from_file(const std::string& filepath);
 
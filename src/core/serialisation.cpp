@@ -14,7 +14,21 @@ bool SceneSerialiser::save_scene(const Scene* scene, const Camera* viewport_came
 
     root_obj["viewport_camera"] = serialise_camera(viewport_camera);
 
-    root_obj["scene"] = serialise_node(scene->get_root());
+    // number the shared geos in the order they're first met, so saves are stable
+    std::unordered_map<const Geo*, int> geo_uses;
+    std::vector<const Geo*> geo_order;
+    collect_shared_geos(scene->get_root(), geo_uses, geo_order);
+
+    SharedGeoIds shared_geo_ids;
+    QJsonArray geos_array;
+    for (const Geo* geo : geo_order) {
+        if (geo_uses[geo] < 2) continue;
+        shared_geo_ids[geo] = int(geos_array.size());
+        geos_array.append(serialise_geo(geo));
+    }
+    if (!geos_array.isEmpty()) root_obj["geos"] = geos_array;
+
+    root_obj["scene"] = serialise_node(scene->get_root(), shared_geo_ids);
 
     QJsonDocument doc(root_obj);
 
@@ -64,8 +78,13 @@ bool SceneSerialiser::load_scene(Scene* scene, Camera* viewport_camera, const QS
         deserialise_camera(viewport_camera, root_obj["viewport_camera"].toObject());
     }
 
+    std::vector<std::shared_ptr<Geo>> shared_geos;
+    for (const auto& geo_val : root_obj["geos"].toArray()) {
+        shared_geos.push_back(deserialise_geo(geo_val.toObject()));
+    }
+
     QJsonObject scene_obj = root_obj["scene"].toObject();
-    auto new_root = deserialise_node(scene_obj);
+    auto new_root = deserialise_node(scene_obj, shared_geos);
 
     //replace scene root
     scene->get_root()->children.clear();
@@ -128,7 +147,15 @@ Material SceneSerialiser::deserialise_material(const QJsonObject& obj)
     return mat;
 }
 
-QJsonObject SceneSerialiser::serialise_node(const SceneNode* node)
+void SceneSerialiser::collect_shared_geos(const SceneNode* node, std::unordered_map<const Geo*, int>& uses, std::vector<const Geo*>& order)
+{
+    if (node->geo && uses[node->geo.get()]++ == 0) order.push_back(node->geo.get());
+    for (const auto& child : node->children) {
+        collect_shared_geos(child.get(), uses, order);
+    }
+}
+
+QJsonObject SceneSerialiser::serialise_node(const SceneNode* node, const SharedGeoIds& shared_geo_ids)
 {
     QJsonObject obj;
 
@@ -174,20 +201,24 @@ QJsonObject SceneSerialiser::serialise_node(const SceneNode* node)
     }
 
     // mesh/lights/etc
-    if (node->geo) obj["geo"] = serialise_geo(node->geo.get());
+    if (node->geo) {
+        auto shared = shared_geo_ids.find(node->geo.get());
+        if (shared != shared_geo_ids.end()) obj["geo_ref"] = shared->second;
+        else obj["geo"] = serialise_geo(node->geo.get());
+    }
     if (node->light) obj["light"] = serialise_light(node->light.get());
     
     //children
     QJsonArray children_array;
     for (const auto& child : node->children) {
-        children_array.append(serialise_node(child.get()));
+        children_array.append(serialise_node(child.get(), shared_geo_ids));
     }
     obj["children"] = children_array;
 
     return obj;
 }
 
-std::unique_ptr<SceneNode> SceneSerialiser::deserialise_node(const QJsonObject& obj) {
+std::unique_ptr<SceneNode> SceneSerialiser::deserialise_node(const QJsonObject& obj, const std::vector<std::shared_ptr<Geo>>& shared_geos) {
 
     auto node = std::make_unique<SceneNode>();
 
@@ -229,13 +260,18 @@ std::unique_ptr<SceneNode> SceneSerialiser::deserialise_node(const QJsonObject&
 
     // geo
     if (obj.contains("geo")) node->geo = deserialise_geo(obj["geo"].toObject());
+    else if (obj.contains("geo_ref")) {
+        int geo_ref = obj["geo_ref"].toInt(-1);
+        if (geo_ref >= 0 && geo_ref < int(shared_geos.size())) node->geo = shared_geos[geo_ref];
+        else qWarning() << "Node " << obj["name"].toString() << " refers to missing geo " << geo_ref;
+    }
     // light
     if (obj.contains("light")) node->light = deserialise_light(obj["light"].toObject());
 
     //children
     QJsonArray children_array = obj["children"].toArray();
     for (const auto& child_val : children_array) {
-        auto child = deserialise_node(child_val.toObject());
+        auto child = deserialise_node(child_val.toObject(), shared_geos);
         node->add_child(std::move(child));
     }
 
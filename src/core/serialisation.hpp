@@ -1,6 +1,9 @@
 #pragma once
 
 #include "scene.hpp"
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QString>
@@ -26,8 +29,13 @@ private:
     static QJsonObject serialise_material(const Material& mat);
     static Material deserialise_material(const QJsonObject& obj);
 
-    static QJsonObject serialise_node(const SceneNode* node);
-    static std::unique_ptr<SceneNode> deserialise_node(const QJsonObject& obj);
+    // geos placed by more than one node are written once into "geos" and the
+    // nodes refer to them by index, so instances come back as instances
+    using SharedGeoIds = std::unordered_map<const Geo*, int>;
+    static void collect_shared_geos(const SceneNode* node, std::unordered_map<const Geo*, int>& uses, std::vector<const Geo*>& order);
+
+    static QJsonObject serialise_node(const SceneNode* node, const SharedGeoIds& shared_geo_ids);
+    static std::unique_ptr<SceneNode> deserialise_node(const QJsonObject& obj, const std::vector<std::shared_ptr<Geo>>& shared_geos);
 
     static QJsonObject serialise_sphere(const SpherePrimitive* sphere);
     static std::unique_ptr<SpherePrimitive> deserialise_sphere(const QJsonObject& obj);
@@ -60,6 +60,11 @@ struct Vec3 {
         return Vec3(-x, -y, -z);
     }
 
+    // == axis access ==
+    float operator[](int axis) const {
+        return axis == 0 ? x : (axis == 1 ? y : z);
+    }
+
     // == functions ==
     float length() const {
         return std::sqrt(x*x + y*y + z*z);
@@ -1,11 +1,13 @@
 #include "panel_raytracer.hpp"
 #include "okaytracer/render_scene.hpp"
+#include "okaytracer/tonemap.hpp"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QGroupBox>
 #include <QLabel>
 #include <QScrollArea>
 #include <QColorSpace>
+#include <QPainter>
 #include <cmath>
 
 namespace ollygon {
@@ -14,6 +16,10 @@ RaytracerWindow::RaytracerWindow(QWidget* parent)
     : QMainWindow(parent)
     , scene(nullptr)
     , camera(nullptr)
+    , display_pool(4) // conversion is memory bound well before this
+    , displayed_render_id(0)
+    , displayed_denoise_revision(0)
+    , displayed_denoised(false)
 {
     setWindowTitle("ollygon - Raytracer");
 
@@ -45,6 +51,7 @@ void RaytracerWindow::setup_ui() {
     QLabel* backend_label = new QLabel("Backend:");
     backend_combo = new QComboBox();
     backend_combo->addItem("CPU");
+    backend_combo->addItem("CPU (wavefront)");
 #ifdef OLLYGON_USE_OPTIX
     backend_combo->addItem("OptiX (GPU)");
 #endif
@@ -80,6 +87,31 @@ void RaytracerWindow::setup_ui() {
     controls_layout->addWidget(bounces_label);
     controls_layout->addWidget(bounces_spinbox);
 
+    light_sampling_checkbox = new QCheckBox("Light Sampling");
+    light_sampling_checkbox->setChecked(render_config.light_sampling);
+    light_sampling_checkbox->setToolTip("Sample emissive quads directly from diffuse hits (CPU only)");
+    controls_layout->addWidget(light_sampling_checkbox);
+
+    QLabel* noise_label = new QLabel("Noise:");
+    noise_spinbox = new QDoubleSpinBox();
+    noise_spinbox->setRange(0.0, 1.0);
+    noise_spinbox->setDecimals(3);
+    noise_spinbox->setSingleStep(0.005);
+    noise_spinbox->setValue(render_config.noise_threshold);
+    noise_spinbox->setSpecialValueText("Off");
+    noise_spinbox->setToolTip("Stop sampling a tile once its relative noise drops below this (CPU only)");
+    controls_layout->addWidget(noise_label);
+    controls_layout->addWidget(noise_spinbox);
+
+    denoise_checkbox = new QCheckBox("Denoise");
+    denoise_checkbox->setToolTip("Preview through the a-trous denoiser, guided by first-hit albedo/normal/depth (CPU only)");
+    // refilter straight away, rather than waiting for the next sample
+    connect(denoise_checkbox, &QCheckBox::toggled, this, [this](bool checked) {
+        raytracer.set_preview_denoise(checked);
+        if (raytracer.acquire_frame()) update_display();
+    });
+    controls_layout->addWidget(denoise_checkbox);
+
     controls_layout->addStretch();
 
     render_button = new QPushButton("Render");
@@ -98,6 +130,10 @@ void RaytracerWindow::setup_ui() {
     time_label = new QLabel("Time: 0.0s");
     controls_layout->addWidget(time_label);
 
+    stats_label = new QLabel();
+    stats_label->setToolTip("Passes and rays per second of render time, CPU backends only");
+    controls_layout->addWidget(stats_label);
+
     main_layout->addWidget(controls_group);
 
     // image display
@@ -142,32 +178,40 @@ void RaytracerWindow::start_render() {
     render_config.height = height_spinbox->value();
     render_config.samples_per_pixel = samples_spinbox->value();
     render_config.max_bounces = bounces_spinbox->value();
-
-    //convert scene
-    okaytracer::RenderScene render_scene = okaytracer::RenderScene::from_scene(scene);
+    render_config.light_sampling = light_sampling_checkbox->isChecked();
+    render_config.noise_threshold = float(noise_spinbox->value());
 
     // set backend from ui
+    QString backend_text = backend_combo->currentText();
 #ifdef OLLYGON_USE_OPTIX
-    if (backend_combo->currentText() == "OptiX (GPU)") {
+    if (backend_text == "OptiX (GPU)") {
         render_config.backend = okaytracer::RenderBackend::OptiX;
         progress_label->setText("Initialising OptiX...");
     }
+    else
+#endif
+    if (backend_text == "CPU (wavefront)") {
+        render_config.backend = okaytracer::RenderBackend::CPUWavefront;
+        progress_label->setText("Starting CPU wavefront render...");
+    }
     else {
         render_config.backend = okaytracer::RenderBackend::CPU;
         progress_label->setText("Starting CPU render...");
     }
-#else
-    render_config.backend = okaytracer::RenderBackend::CPU;
-    progress_label->setText("Starting CPU render...");
-#endif
 
-    // start raytracer!
-    raytracer.start_render(render_scene, *camera, render_config);
+    // start raytracer!  it converts the scene itself, so a re-render only redoes
+    // the nodes edited since.  samples on its own thread, we just pick up frames
+    raytracer.start_render(scene, *camera, render_config);
+    raytracer.set_preview_denoise(denoise_checkbox->isChecked());
+    raytracer.render_async();
 
     //update ui to show which backend is actually running
-    QString backend_name = (raytracer.get_active_backend() == okaytracer::RenderBackend::OptiX)
-        ? "OptiX (GPU)"
-        : "CPU";
+    QString backend_name;
+    switch (raytracer.get_active_backend()) {
+    case okaytracer::RenderBackend::OptiX: backend_name = "OptiX (GPU)"; break;
+    case okaytracer::RenderBackend::CPUWavefront: backend_name = "CPU (wavefront)"; break;
+    default: backend_name = "CPU"; break;
+    }
     progress_label->setText(QString("Rendering on %1...").arg(backend_name));
 
     // prepare display image
@@ -180,22 +224,31 @@ void RaytracerWindow::start_render() {
     height_spinbox->setEnabled(false);
     samples_spinbox->setEnabled(false);
     bounces_spinbox->setEnabled(false);
+    noise_spinbox->setEnabled(false);
 
     render_timer.start();
+    stats_label->clear();
 
-    update_timer->start(33); //30fps
+    update_timer->start(33); //30fps, or as fast as frames come if slower
 }
 
 void RaytracerWindow::stop_render() {
     raytracer.stop_render();
     update_timer->stop();
 
+    // show whatever the cancelled pass got through
+    if (raytracer.acquire_frame()) {
+        update_display();
+    }
+    update_stats();
+
     render_button->setEnabled(true);
     stop_button->setEnabled(false);
     width_spinbox->setEnabled(true);
     height_spinbox->setEnabled(true);
     samples_spinbox->setEnabled(true);
     bounces_spinbox->setEnabled(true);
+    noise_spinbox->setEnabled(true);
 
     qint64 elapsed_ms = render_timer.elapsed();
     float elapsed_sec = elapsed_ms / 1000.0f;
@@ -204,59 +257,116 @@ void RaytracerWindow::stop_render() {
 }
 
 void RaytracerWindow::update_render() {
-    if (!raytracer.is_rendering()) {
+    // checked before picking up a frame, so once it's false the last frame is already published
+    const bool finished = !raytracer.is_rendering();
+
+    if (raytracer.acquire_frame()) {
+        update_display();
+        update_stats();
+    }
+
+    if (finished) {
         stop_render();
-        progress_label->setText("Complete!");
-        
+
         qint64 elapsed_ms = render_timer.elapsed();
         float elapsed_sec = elapsed_ms / 1000.0f;
-        progress_label->setText(QString("Complete! (%1 samples)").arg(render_config.samples_per_pixel));
+        // adaptive sampling can finish early, so report what was actually taken
+        progress_label->setText(QString("Complete! (%1 samples)").arg(raytracer.get_frame().samples));
         time_label->setText(QString("Time: %1s").arg(elapsed_sec, 0, 'f', 2));
 
         return;
     }
 
-    raytracer.render_one_sample();
-
-    // update progress...might be better on less samples?
-    float progress = raytracer.get_progress();
+    float progress = raytracer.get_frame().progress;
 
     qint64 elapsed_ms = render_timer.elapsed();
     float elapsed_sec = elapsed_ms / 1000.0f;
     progress_label->setText(QString("Rendering... %1%").arg(int(progress * 100)));
     time_label->setText(QString("Time: %1s").arg(elapsed_sec, 0, 'f', 1));
-
-    update_display();
 }
 
-void RaytracerWindow::update_display() {
-    const std::vector<float>& pixels = raytracer.get_pixels();
-
-    if (pixels.empty()) return;
+void RaytracerWindow::update_stats() {
+    const okaytracer::RenderStats& stats = raytracer.get_frame().stats;
+    // nothing counted yet, or the OptiX backend, which doesn't count
+    if (stats.wall_ms <= 0.0 || stats.rays == 0) {
+        stats_label->clear();
+        return;
+    }
 
-    int width = raytracer.get_width();
-    int height = raytracer.get_height();
+    const double seconds = stats.wall_ms / 1000.0;
+    stats_label->setText(QString("%1 samples/s, %2 Mrays/s")
+        .arg(raytracer.get_frame().samples / seconds, 0, 'f', 1)
+        .arg(stats.mrays_per_second(), 0, 'f', 1));
+}
 
-    // convert float RGB to QImage - same method as Shirley's PPM
-    for (int j = 0; j < height; ++j) {
-        for (int i = 0; i < width; ++i) {
-            int idx = (j * width + i) * 3;
+void RaytracerWindow::update_display() {
+    const okaytracer::RenderFrame& frame = raytracer.get_frame();
+    if (frame.pixels.empty()) return;
 
-            // gamma correction (gamma = 2.0)
-            float r = std::sqrt(std::clamp(pixels[idx + 0], 0.0f, 1.0f));
-            float g = std::sqrt(std::clamp(pixels[idx + 1], 0.0f, 1.0f));
-            float b = std::sqrt(std::clamp(pixels[idx + 2], 0.0f, 1.0f));
+    const bool denoised = !frame.denoised.empty();
+    const std::vector<float>& pixels = denoised ? frame.denoised : frame.pixels;
 
-            int ir = int(r * 255.99f);
-            int ig = int(g * 255.99f);
-            int ib = int(b * 255.99f);
+    // written straight into the image's rows below, so it has to be the frame's size
+    const bool resized = display_image.width() != frame.width || display_image.height() != frame.height;
+    if (resized) {
+        display_image = QImage(frame.width, frame.height, QImage::Format_RGB32);
+        display_image.setColorSpace(QColorSpace::SRgb);
+    }
 
-            display_image.setPixel(i, j, qRgb(ir, ig, ib));
+    // a refiltered denoise changes everywhere, and without tiles (OptiX) or
+    // from another render there's nothing to compare against
+    const bool redraw_all = resized || display_pixmap.isNull()
+        || frame.tiles.empty() || frame.tiles.size() != displayed_tile_samples.size()
+        || frame.render_id != displayed_render_id
+        || denoised != displayed_denoised
+        || (denoised && frame.denoise_revision != displayed_denoise_revision);
+
+    if (redraw_all) {
+        okaytracer::tonemap_rgb32(pixels.data(), frame.width, frame.height,
+            display_image.bits(), size_t(display_image.bytesPerLine()), &display_pool);
+        display_pixmap = QPixmap::fromImage(display_image);
+    }
+    else if (!denoised) {
+        std::vector<int> dirty;
+        for (int i = 0; i < int(frame.tiles.size()); ++i) {
+            if (frame.tiles[i].samples != displayed_tile_samples[i]) dirty.push_back(i);
+        }
+        // no pass finished since the last frame shown, or only converged tiles left
+        if (dirty.empty()) return;
+
+        // bits() can detach, so once here rather than from every pool thread
+        uint8_t* bits = display_image.bits();
+        const size_t stride = size_t(display_image.bytesPerLine());
+        display_pool.parallel_for(int(dirty.size()), [&](int i) {
+            const okaytracer::Tile& tile = frame.tiles[dirty[i]];
+            okaytracer::tonemap_rgb32_region(pixels.data(), frame.width,
+                tile.start_x, tile.end_x, tile.start_y, tile.end_y, bits, stride);
+        });
+
+        // the label shares display_pixmap, painting into it while it does would copy the lot
+        image_label->setPixmap(QPixmap());
+        QPainter painter(&display_pixmap);
+        for (int index : dirty) {
+            const okaytracer::Tile& tile = frame.tiles[index];
+            const QRect rect(tile.start_x, tile.start_y, tile.end_x - tile.start_x, tile.end_y - tile.start_y);
+            painter.drawImage(rect.topLeft(), display_image, rect);
         }
     }
+    else {
+        // the same denoise as last time, whatever the samples underneath did
+        return;
+    }
+
+    displayed_tile_samples.resize(frame.tiles.size());
+    for (size_t i = 0; i < frame.tiles.size(); ++i) {
+        displayed_tile_samples[i] = frame.tiles[i].samples;
+    }
+    displayed_render_id = frame.render_id;
+    displayed_denoise_revision = frame.denoise_revision;
+    displayed_denoised = denoised;
 
-    image_label->setPixmap(QPixmap::fromImage(display_image));
-    image_label->adjustSize();
+    image_label->setPixmap(display_pixmap);
+    if (redraw_all) image_label->adjustSize();
 }
 
 } // namespace ollygon
@@ -4,9 +4,12 @@
 #include <QLabel>
 #include <QPushButton>
 #include <QSpinBox>
+#include <QDoubleSpinBox>
 #include <QTimer>
 #include <QElapsedTimer>
 #include <QImage>
+#include <QPixmap>
+#include <QCheckBox>
 #include <QComboBox> //TODO maybe forward dec some of these..
 #include "core/scene.hpp"
 #include "core/camera.hpp"
@@ -36,6 +39,7 @@ private slots:
 private:
     void setup_ui();
     void update_display();
+    void update_stats(); // samples/s and Mrays/s from the current frame's counters
 
     const Scene* scene;
     const Camera* camera;
@@ -45,6 +49,14 @@ private:
 
     QLabel* image_label;
     QImage display_image;
+    QPixmap display_pixmap; // what image_label shows, tiles are redrawn into it as they change
+    okaytracer::ThreadPool display_pool; // tonemaps frames into display_image, apart from the render's pool
+
+    // what's in display_image, to tell which tiles a new frame changed
+    std::vector<int> displayed_tile_samples;
+    uint64_t displayed_render_id;
+    uint64_t displayed_denoise_revision;
+    bool displayed_denoised;
 
     QPushButton* render_button;
     QPushButton* stop_button;
@@ -52,6 +64,9 @@ private:
     QSpinBox* bounces_spinbox;
     QSpinBox* width_spinbox;
     QSpinBox* height_spinbox;
+    QCheckBox* light_sampling_checkbox;
+    QCheckBox* denoise_checkbox;
+    QDoubleSpinBox* noise_spinbox;
     QLabel* progress_label;
     QComboBox* backend_combo;
 
@@ -59,6 +74,7 @@ private:
 
     QElapsedTimer render_timer;
     QLabel* time_label;
+    QLabel* stats_label;
 };
 
 } // namespace ollygon
@@ -71,12 +71,21 @@ void SceneHierarchyTree::contextMenuEvent(QContextMenuEvent* event)
     if (!node || node->name == "root") return;
 
     QMenu menu(this);
+    // meshes only, prims are cheap enough to just duplicate
+    QAction* instance_action = nullptr;
+    if (node->node_type == NodeType::Mesh && node->geo) {
+        instance_action = menu.addAction("Instance");
+    }
     QAction* delete_action = menu.addAction("Delete");
 
     QAction* selected = menu.exec(event->globalPos());
+    if (!selected) return;
     if (selected == delete_action) {
         emit delete_requested(node);
     }
+    else if (selected == instance_action) {
+        emit instance_requested(node);
+    }
 }
 
 // Qt's native Windows style seems to  aggressively paint its own bg in drawRow(), 
@@ -292,6 +301,7 @@ PanelSceneHierarchy::PanelSceneHierarchy(QWidget* parent)
     // connect tree/filter
     connect(filter_edit, &QLineEdit::textChanged, this, &PanelSceneHierarchy::on_filter_changed);
     connect(tree, &SceneHierarchyTree::delete_requested, this, &PanelSceneHierarchy::on_delete_node);
+    connect(tree, &SceneHierarchyTree::instance_requested, this, &PanelSceneHierarchy::on_instance_node);
 
     // event filter so that Esc can clear text too
     filter_edit->installEventFilter(this);
@@ -352,6 +362,17 @@ void PanelSceneHierarchy::on_delete_node(SceneNode* node)
     }
 }
 
+void PanelSceneHierarchy::on_instance_node(SceneNode* node)
+{
+    if (!scene || !node) return;
+
+    if (SceneNode* instance = SceneOperations::instance_node(node)) {
+        rebuild_tree();
+        emit node_created(instance);
+        emit scene_modified();
+    }
+}
+
 void PanelSceneHierarchy::show_create_menu()
 {
     if (!scene) return;
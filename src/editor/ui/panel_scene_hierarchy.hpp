@@ -29,6 +29,7 @@ signals:
     void node_visibility_toggled(SceneNode* node);
     void node_locked_toggled(SceneNode* node);
     void delete_requested(SceneNode* node);
+    void instance_requested(SceneNode* node);
 
 protected:
     void paintEvent(QPaintEvent* event) override;
@@ -76,6 +77,7 @@ private slots:
     void on_filter_changed(const QString& new_text);
     void on_add_button_clicked();
     void on_delete_node(SceneNode* node);
+    void on_instance_node(SceneNode* node);
 
 private:
     void show_create_menu();
@@ -3,13 +3,34 @@
 #include <QWheelEvent>
 #include <QResizeEvent>
 #include <QPainter>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include "panel_scene_hierarchy.hpp"
 #include "core/selection_system.hpp"
+#include "okaytracer/tonemap.hpp"
 
 namespace ollygon {
 
+    namespace {
+
+        // raytraced mode's progressive restart.  the first two stages are a
+        // pass or two at low resolution so there's a picture almost straight
+        // away, the last accumulates until adaptive sampling calls it converged
+        struct RaytraceStage {
+            int divisor;
+            int samples;
+        };
+
+        const RaytraceStage RAYTRACE_STAGES[] = {
+            { 4, 1 },
+            { 2, 2 },
+            { 1, 4096 },
+        };
+        const int RAYTRACE_STAGE_COUNT = int(sizeof(RAYTRACE_STAGES) / sizeof(RAYTRACE_STAGES[0]));
+
+    } // namespace
+
     PanelViewport::PanelViewport(QWidget* parent)
         : QOpenGLWidget(parent)
         , scene(nullptr)
@@ -23,11 +44,21 @@ namespace ollygon {
         , is_camera_dragging(false)
         , toolbar_edit_mode(nullptr)
         , toolbar_selection_mode(nullptr)
+        , raytrace_timer(nullptr)
+        , raytraced(false)
+        , raytrace_stage(0)
     {
         setMouseTracking(true);
+
+        raytrace_timer = new QTimer(this);
+        connect(raytrace_timer, &QTimer::timeout, this, &PanelViewport::update_raytrace);
+        connect(this, &PanelViewport::camera_moved, this, &PanelViewport::restart_raytrace);
     }
 
     PanelViewport::~PanelViewport() {
+        // join its render thread while everything else is still here
+        if (raytracer) raytracer->stop_render();
+
         makeCurrent();
         vao.destroy();
         vbo.destroy();
@@ -48,6 +79,75 @@ namespace ollygon {
         update();
     }
 
+    void PanelViewport::set_raytraced(bool enabled) {
+        if (enabled == raytraced) return;
+        raytraced = enabled;
+
+        if (raytraced) {
+            if (!raytracer) raytracer = std::make_unique<okaytracer::Raytracer>();
+            restart_raytrace();
+        }
+        else {
+            raytrace_timer->stop();
+            if (raytracer) raytracer->stop_render();
+            raytrace_image = QImage();
+        }
+        update();
+    }
+
+    void PanelViewport::restart_raytrace() {
+        if (!raytraced || !scene) return;
+
+        raytrace_stage = 0;
+        start_raytrace_stage();
+    }
+
+    void PanelViewport::start_raytrace_stage() {
+        const RaytraceStage& stage = RAYTRACE_STAGES[raytrace_stage];
+
+        okaytracer::RenderConfig config;
+        config.width = std::max(1, width() / stage.divisor);
+        config.height = std::max(1, height() / stage.divisor);
+        config.samples_per_pixel = stage.samples;
+        config.aovs = 0; // nothing here denoises
+        // the preview stages are too few samples to judge convergence on
+        if (stage.samples < config.min_samples) config.noise_threshold = 0.0f;
+
+        // converts only what changed since the last stage, so restarting on
+        // every mouse move is mostly just the render
+        raytracer->start_render(scene, camera, config);
+        raytracer->render_async();
+        raytrace_timer->start(33);
+    }
+
+    void PanelViewport::update_raytrace() {
+        // checked first so the stage's final frame is picked up below
+        const bool finished = !raytracer->is_rendering();
+
+        if (raytracer->acquire_frame()) {
+            const okaytracer::RenderFrame& frame = raytracer->get_frame();
+            if (!frame.pixels.empty()) {
+                if (raytrace_image.width() != frame.width || raytrace_image.height() != frame.height) {
+                    raytrace_image = QImage(frame.width, frame.height, QImage::Format_RGB32);
+                }
+
+                okaytracer::tonemap_rgb32(frame.pixels.data(), frame.width, frame.height,
+                    raytrace_image.bits(), size_t(raytrace_image.bytesPerLine()));
+                update();
+            }
+        }
+
+        if (!finished) return;
+
+        if (raytrace_stage + 1 < RAYTRACE_STAGE_COUNT) {
+            raytrace_stage++;
+            start_raytrace_stage();
+        }
+        else {
+            raytrace_timer->stop();
+        }
+    }
+
     void PanelViewport::set_selection_handler(SelectionHandler* handler) {
         selection_handler = handler;
 
@@ -536,6 +636,7 @@ namespace ollygon {
     void PanelViewport::resizeGL(int w, int h) {
         glViewport(0, 0, w, h);
         camera.set_aspect((float)w / (float)h);
+        restart_raytrace();
     }
 
     void PanelViewport::rebuild_scene_geometry() {
@@ -665,6 +766,11 @@ namespace ollygon {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         if (!scene) return;
+
+        if (raytraced) {
+            render_raytraced();
+            return;
+        }
         
         if (scene) {
             const Sky& sky = scene->get_sky();
@@ -705,6 +811,25 @@ namespace ollygon {
         render_box_select_overlay();
     }
 
+    void PanelViewport::render_raytraced() {
+        QPainter painter(this);
+        // the low res stages stay blocky rather than smeared
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+        if (!raytrace_image.isNull()) {
+            painter.drawImage(rect(), raytrace_image);
+        }
+
+        // no depth to test the overlays against, they just go on top
+        painter.beginNativePainting();
+        glDisable(GL_DEPTH_TEST);
+        render_component_selection();
+        glEnable(GL_DEPTH_TEST);
+        painter.endNativePainting();
+        painter.end();
+
+        render_box_select_overlay();
+    }
+
     void PanelViewport::render_node(SceneNode* node, bool render_transparent) {
         if (!node || !node->visible) return;
 
@@ -6,6 +6,9 @@
 #include <QOpenGLBuffer>
 #include <QOpenGLVertexArrayObject>
 #include <QMouseEvent>
+#include <QImage>
+#include <QTimer>
+#include <memory>
 #include <unordered_map>
 #include "core/scene.hpp"
 #include "core/camera.hpp"
@@ -13,6 +16,7 @@
 #include "core/edit_mode.hpp"
 #include "toolbar_edit_mode.hpp"
 #include "toolbar_selection_mode.hpp"
+#include "okaytracer/raytracer.hpp"
 
 namespace ollygon {
 
@@ -34,7 +38,17 @@ public:
     void set_edit_mode_manager(EditModeManager* manager);
     Camera* get_camera() { return &camera; }
 
-    void mark_geometry_dirty() { geometry_dirty = true; }
+    void mark_geometry_dirty() { geometry_dirty = true; restart_raytrace(); }
+
+    // draw with the okaytracer instead of GL.  after any change it restarts at
+    // 1/4 then 1/2 resolution, then keeps adding samples at full resolution for
+    // as long as nothing moves
+    void set_raytraced(bool enabled);
+    bool is_raytraced() const { return raytraced; }
+
+public slots:
+    // scene or camera changed, starts the raytraced view over.  no-op in GL mode
+    void restart_raytrace();
 
 protected:
     void initializeGL() override;
@@ -54,6 +68,10 @@ private:
     void render_box_select_overlay();
     void position_toolbars();
 
+    void start_raytrace_stage();
+    void update_raytrace(); // timer, shows new frames and moves on to the next stage
+    void render_raytraced();
+
     Scene* scene;
     Camera camera;
     SelectionHandler* selection_handler;
@@ -81,6 +99,14 @@ private:
     ToolbarEditMode* toolbar_edit_mode;
     ToolbarSelectionMode* toolbar_selection_mode;
 
+    // == raytraced mode ==
+
+    std::unique_ptr<okaytracer::Raytracer> raytracer; // made on first use, it brings up a thread pool
+    QTimer* raytrace_timer;
+    QImage raytrace_image;
+    bool raytraced;
+    int raytrace_stage; // into RAYTRACE_STAGES
+
     // == edit modes ==
 
     EditModeManager* edit_mode_manager;
@@ -337,6 +337,8 @@ void MainWindow::create_dock_widgets() {
     //// connect us up to signals from them
     // visible/locked toggled on properties?:
     connect(properties_panel, &PropertiesPanel::properties_changed, scene_hierarchy->tree, &SceneHierarchyTree::refresh_display);
+    // and the raytraced viewport has to start over on any edit
+    connect(properties_panel, &PropertiesPanel::properties_changed, viewport, &PanelViewport::restart_raytrace);
     // scene modified from hierarchy and needs to update over onto properties?:
     connect(scene_hierarchy, &PanelSceneHierarchy::scene_modified, properties_panel, &PropertiesPanel::refresh_from_node);
     // visible/locked toggled, or items added/deleted on hierarchy?:
@@ -347,6 +349,7 @@ void MainWindow::create_dock_widgets() {
     // scene settings to viewport update
     connect(scene_settings_panel, &PanelSceneSettings::settings_changed,
         viewport, [this]() {
+            viewport->restart_raytrace();
             viewport->update();
         });
 
@@ -371,6 +374,8 @@ void MainWindow::create_dock_widgets() {
 
     // connect viewport updates to refresh camera properties
     connect(viewport, &PanelViewport::camera_moved, properties_panel, &PropertiesPanel::refresh_camera_properties);
+    // and camera edits on properties restart the raytraced viewport, same as moving it by mouse
+    connect(properties_panel, &PropertiesPanel::camera_properties_changed, viewport, &PanelViewport::restart_raytrace);
 
     scene_dock->setWidget(scene_hierarchy);
     addDockWidget(Qt::LeftDockWidgetArea, scene_dock);
@@ -417,6 +422,12 @@ void MainWindow::create_menus() {
     QAction* show_raytracer_action = new QAction("Show &Raytracer", this);
     connect(show_raytracer_action, &QAction::triggered, this, &MainWindow::show_raytracer_window);
     render_menu->addAction(show_raytracer_action);
+
+    QAction* raytraced_viewport_action = new QAction("Raytraced &Viewport", this);
+    raytraced_viewport_action->setCheckable(true);
+    raytraced_viewport_action->setShortcut(QKeySequence(Qt::Key_F5));
+    connect(raytraced_viewport_action, &QAction::toggled, viewport, &PanelViewport::set_raytraced);
+    render_menu->addAction(raytraced_viewport_action);
 }
 
 void MainWindow::setup_shortcuts() {
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../core/vec3.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace ollygon {
+namespace okaytracer {
+
+// axis-aligned bounding box. default constructed as "empty" (inverted) so the
+// first expand() snaps it to whatever it's given
+struct Aabb {
+    Vec3 min;
+    Vec3 max;
+
+    Aabb()
+        : min(std::numeric_limits<float>::infinity())
+        , max(-std::numeric_limits<float>::infinity())
+    {}
+    Aabb(const Vec3& _min, const Vec3& _max) : min(_min), max(_max) {}
+
+    void expand(const Vec3& p) {
+        min = Vec3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = Vec3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+
+    void expand(const Aabb& other) {
+        min = Vec3(std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z));
+        max = Vec3(std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z));
+    }
+
+    bool is_empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+    Vec3 centre() const { return (min + max) * 0.5f; }
+    Vec3 extent() const { return max - min; }
+
+    // SAH wants half the surface area really, but it's only ever used as a ratio
+    float surface_area() const {
+        if (is_empty()) return 0.0f;
+        Vec3 e = extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // slab test. inv_dir is precomputed once per ray as it's the hot path
+    bool intersect(const Vec3& origin, const Vec3& inv_dir, float t_min, float t_max, float& t_entry) const {
+        float tx1 = (min.x - origin.x) * inv_dir.x;
+        float tx2 = (max.x - origin.x) * inv_dir.x;
+        float t_near = std::min(tx1, tx2);
+        float t_far = std::max(tx1, tx2);
+
+        float ty1 = (min.y - origin.y) * inv_dir.y;
+        float ty2 = (max.y - origin.y) * inv_dir.y;
+        t_near = std::max(t_near, std::min(ty1, ty2));
+        t_far = std::min(t_far, std::max(ty1, ty2));
+
+        float tz1 = (min.z - origin.z) * inv_dir.z;
+        float tz2 = (max.z - origin.z) * inv_dir.z;
+        t_near = std::max(t_near, std::min(tz1, tz2));
+        t_far = std::min(t_far, std::max(tz1, tz2));
+
+        t_entry = std::max(t_near, t_min);
+        return t_far >= t_entry && t_entry <= t_max;
+    }
+};
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,232 @@
+#define NOMINMAX
+
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+
+namespace ollygon {
+namespace okaytracer {
+
+void Bvh::clear() {
+    nodes.clear();
+    prim_indices.clear();
+    parents.clear();
+    prim_leaf.clear();
+    built_root_area = 0.0f;
+}
+
+void Bvh::build(const std::vector<Aabb>& prim_bounds) {
+    clear();
+    if (prim_bounds.empty()) return;
+
+    prim_indices.resize(prim_bounds.size());
+    std::iota(prim_indices.begin(), prim_indices.end(), 0u);
+
+    std::vector<Vec3> centroids(prim_bounds.size());
+    for (size_t i = 0; i < prim_bounds.size(); ++i) {
+        centroids[i] = prim_bounds[i].centre();
+    }
+
+    // binary tree over n leaves has at most 2n-1 nodes
+    nodes.reserve(prim_bounds.size() * 2);
+
+    BvhNode root;
+    root.left_first = 0;
+    root.prim_count = uint32_t(prim_bounds.size());
+    nodes.push_back(root);
+
+    update_node_bounds(0, prim_bounds);
+    built_root_area = nodes[0].bounds.surface_area();
+    subdivide(0, 0, prim_bounds, centroids);
+
+    nodes.shrink_to_fit();
+
+    // links back up the tree, only refit() needs them
+    parents.assign(nodes.size(), 0);
+    prim_leaf.assign(prim_bounds.size(), 0);
+    for (uint32_t i = 0; i < uint32_t(nodes.size()); ++i) {
+        const BvhNode& node = nodes[i];
+        if (node.is_leaf()) {
+            for (uint32_t k = 0; k < node.prim_count; ++k) {
+                prim_leaf[prim_indices[node.left_first + k]] = i;
+            }
+        }
+        else {
+            parents[node.left_first] = i;
+            parents[node.left_first + 1] = i;
+        }
+    }
+}
+
+void Bvh::refit(const std::vector<Aabb>& prim_bounds, const std::vector<uint32_t>& changed_prims) {
+    if (nodes.empty()) return;
+
+    // every node above a changed prim, each once
+    std::vector<uint8_t> marked(nodes.size(), 0);
+    std::vector<uint32_t> stale;
+    for (uint32_t prim : changed_prims) {
+        uint32_t node_index = prim_leaf[prim];
+        while (!marked[node_index]) {
+            marked[node_index] = 1;
+            stale.push_back(node_index);
+            if (node_index == 0) break;
+            node_index = parents[node_index];
+        }
+    }
+
+    // children always come after their parent, so going by index from the
+    // back does every node after both of its children
+    std::sort(stale.begin(), stale.end(), std::greater<uint32_t>());
+    for (uint32_t node_index : stale) {
+        BvhNode& node = nodes[node_index];
+        if (node.is_leaf()) {
+            update_node_bounds(node_index, prim_bounds);
+        }
+        else {
+            node.bounds = nodes[node.left_first].bounds;
+            node.bounds.expand(nodes[node.left_first + 1].bounds);
+        }
+    }
+}
+
+float Bvh::sah_cost() const {
+    if (nodes.empty() || built_root_area <= 0.0f) return 0.0f;
+
+    float cost = 0.0f;
+    for (const BvhNode& node : nodes) {
+        cost += node.bounds.surface_area() * (node.is_leaf() ? float(node.prim_count) : 1.0f);
+    }
+    return cost / built_root_area;
+}
+
+void Bvh::update_node_bounds(uint32_t node_index, const std::vector<Aabb>& prim_bounds) {
+    BvhNode& node = nodes[node_index];
+    node.bounds = Aabb();
+    for (uint32_t i = 0; i < node.prim_count; ++i) {
+        node.bounds.expand(prim_bounds[prim_indices[node.left_first + i]]);
+    }
+}
+
+void Bvh::subdivide(uint32_t node_index, int depth, const std::vector<Aabb>& prim_bounds, const std::vector<Vec3>& centroids) {
+    // careful - no refs into nodes held over push_back
+    const uint32_t first = nodes[node_index].left_first;
+    const uint32_t count = nodes[node_index].prim_count;
+
+    if (count <= 1 || depth >= MAX_DEPTH - 1) return;
+
+    Aabb centroid_bounds;
+    for (uint32_t i = 0; i < count; ++i) {
+        centroid_bounds.expand(centroids[prim_indices[first + i]]);
+    }
+
+    // == binned SAH ==
+    struct Bin {
+        Aabb bounds;
+        uint32_t count = 0;
+    };
+
+    float best_cost = std::numeric_limits<float>::infinity();
+    int best_axis = -1;
+    int best_split = 0;
+
+    for (int axis = 0; axis < 3; ++axis) {
+        float axis_min = centroid_bounds.min[axis];
+        float axis_max = centroid_bounds.max[axis];
+        if (axis_max <= axis_min) continue; // all centroids flat on this axis
+
+        Bin bins[SAH_BINS];
+        float scale = float(SAH_BINS) / (axis_max - axis_min);
+
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t prim = prim_indices[first + i];
+            int b = std::min(SAH_BINS - 1, int((centroids[prim][axis] - axis_min) * scale));
+            bins[b].count++;
+            bins[b].bounds.expand(prim_bounds[prim]);
+        }
+
+        // sweep both ways so each split plane gets its left & right area/count
+        float left_area[SAH_BINS - 1];
+        uint32_t left_count[SAH_BINS - 1];
+        float right_area[SAH_BINS - 1];
+        uint32_t right_count[SAH_BINS - 1];
+
+        Aabb left_box, right_box;
+        uint32_t left_sum = 0, right_sum = 0;
+        for (int i = 0; i < SAH_BINS - 1; ++i) {
+            left_sum += bins[i].count;
+            left_box.expand(bins[i].bounds);
+            left_count[i] = left_sum;
+            left_area[i] = left_box.surface_area();
+
+            right_sum += bins[SAH_BINS - 1 - i].count;
+            right_box.expand(bins[SAH_BINS - 1 - i].bounds);
+            right_count[SAH_BINS - 2 - i] = right_sum;
+            right_area[SAH_BINS - 2 - i] = right_box.surface_area();
+        }
+
+        for (int i = 0; i < SAH_BINS - 1; ++i) {
+            if (left_count[i] == 0 || right_count[i] == 0) continue;
+            float cost = left_count[i] * left_area[i] + right_count[i] * right_area[i];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = i;
+            }
+        }
+    }
+
+    if (best_axis < 0) return; // nothing to split on, stays a leaf
+
+    // SAH with traversal cost 1, intersection cost 1, relative to parent area
+    float parent_area = nodes[node_index].bounds.surface_area();
+    float split_cost = parent_area > 0.0f ? 1.0f + best_cost / parent_area : float(count);
+    float leaf_cost = float(count);
+    if (split_cost >= leaf_cost && count <= MAX_LEAF_PRIMS) return;
+
+    // partition prim_indices in place around the chosen bin boundary
+    float axis_min = centroid_bounds.min[best_axis];
+    float scale = float(SAH_BINS) / (centroid_bounds.max[best_axis] - axis_min);
+
+    uint32_t* begin = prim_indices.data() + first;
+    uint32_t* mid = std::partition(begin, begin + count, [&](uint32_t prim) {
+        int b = std::min(SAH_BINS - 1, int((centroids[prim][best_axis] - axis_min) * scale));
+        return b <= best_split;
+    });
+
+    uint32_t left_count = uint32_t(mid - begin);
+    if (left_count == 0 || left_count == count) return;
+
+    uint32_t left_index = uint32_t(nodes.size());
+    BvhNode left, right;
+    left.left_first = first;
+    left.prim_count = left_count;
+    right.left_first = first + left_count;
+    right.prim_count = count - left_count;
+    nodes.push_back(left);
+    nodes.push_back(right);
+
+    nodes[node_index].left_first = left_index;
+    nodes[node_index].prim_count = 0;
+
+    update_node_bounds(left_index, prim_bounds);
+    update_node_bounds(left_index + 1, prim_bounds);
+
+    subdivide(left_index, depth + 1, prim_bounds, centroids);
+    subdivide(left_index + 1, depth + 1, prim_bounds, centroids);
+}
+
+Vec3 Bvh::safe_inverse(const Vec3& dir) {
+    // avoid 0 * inf = NaN in the slab test for axis-aligned rays
+    const float tiny = 1e-20f;
+    return Vec3(
+        1.0f / (std::abs(dir.x) > tiny ? dir.x : std::copysign(tiny, dir.x)),
+        1.0f / (std::abs(dir.y) > tiny ? dir.y : std::copysign(tiny, dir.y)),
+        1.0f / (std::abs(dir.z) > tiny ? dir.z : std::copysign(tiny, dir.z))
+    );
+}
+
+} // namespace okaytracer
+} // namespace ollygon
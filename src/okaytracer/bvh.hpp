@@ -0,0 +1,230 @@
+#pragma once
+
+#include "aabb.hpp"
+#include "ray.hpp"
+#include "ray_packet.hpp"
+#include <vector>
+#include <cstdint>
+
+namespace ollygon {
+namespace okaytracer {
+
+// 32 bytes, two per cache line
+struct BvhNode {
+    Aabb bounds;
+    uint32_t left_first; // interior: index of left child (right is left+1). leaf: first entry in prim_indices
+    uint32_t prim_count; // 0 for interior nodes
+
+    bool is_leaf() const { return prim_count > 0; }
+};
+
+// binary BVH built with binned SAH.  only knows about bounds, so it doesn't
+// care whether the things it holds are spheres, quads or tris - the caller
+// resolves prim_indices back into whatever it built from
+class Bvh {
+public:
+    void build(const std::vector<Aabb>& prim_bounds);
+    void clear();
+
+    // keeps the tree's shape and recomputes bounds up from the leaves holding
+    // changed_prims, after their entries in prim_bounds have moved.  fast, but
+    // the tree gets worse the further things move from where it was built,
+    // check sah_cost() against the build's to know when to build again
+    void refit(const std::vector<Aabb>& prim_bounds, const std::vector<uint32_t>& changed_prims);
+
+    // expected cost of a random ray through the tree, relative to the root's area
+    // when it was built: 1 per interior node and 1 per prim in a leaf, each weighted
+    // by its area.  not the current root's, a refit that grows the root would
+    // otherwise shrink every ratio and hide the tree getting worse
+    float sah_cost() const;
+
+    bool empty() const { return nodes.empty(); }
+
+    const std::vector<BvhNode>& get_nodes() const { return nodes; }
+    const std::vector<uint32_t>& get_prim_indices() const { return prim_indices; }
+
+    // front-to-back closest hit traversal.  intersect_prim(prim_index, t_max) should
+    // return true on a hit closer than t_max and update t_max to the new hit distance
+    template <typename IntersectPrim>
+    bool traverse(const Ray& ray, float t_min, float& t_max, IntersectPrim&& intersect_prim) const;
+
+    // same again for a packet of 4 rays sharing one walk down the tree.  a node is
+    // entered if any active lane hits it.  intersect_prim(prim_index, packet) tests
+    // the prim against every lane and records closer hits via packet.record_hits().
+    // node_visits is added to once per node the packet goes into
+    template <typename IntersectPacket>
+    bool traverse_packet(RayPacket& packet, float t_min, IntersectPacket&& intersect_prim, uint64_t& node_visits) const;
+
+    static Vec3 safe_inverse(const Vec3& dir);
+
+private:
+    // per-lane slab test, returns the mask of lanes that hit within [t_min, packet.t_max]
+    static Float4 intersect_packet(const Aabb& box, const RayPacket& packet, const Float4 inv_dir[3], const Float4& t_min, Float4& t_entry);
+
+    void subdivide(uint32_t node_index, int depth, const std::vector<Aabb>& prim_bounds, const std::vector<Vec3>& centroids);
+    void update_node_bounds(uint32_t node_index, const std::vector<Aabb>& prim_bounds);
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> prim_indices;
+    std::vector<uint32_t> parents;   // per node, for refitting upwards.  the root's is itself
+    std::vector<uint32_t> prim_leaf; // per prim, the leaf node it ended up in
+    float built_root_area = 0.0f;    // sah_cost() is relative to this, refits leave it alone
+
+    static constexpr int SAH_BINS = 16;
+    static constexpr uint32_t MAX_LEAF_PRIMS = 8;
+    static constexpr int MAX_DEPTH = 64; // caps build depth, so also bounds the traversal stack
+};
+
+template <typename IntersectPrim>
+bool Bvh::traverse(const Ray& ray, float t_min, float& t_max, IntersectPrim&& intersect_prim) const
+{
+    if (nodes.empty()) return false;
+
+    Vec3 inv_dir = safe_inverse(ray.direction);
+
+    float t_entry;
+    if (!nodes[0].bounds.intersect(ray.origin, inv_dir, t_min, t_max, t_entry)) return false;
+
+    uint32_t stack[MAX_DEPTH];
+    int stack_ptr = 0;
+    uint32_t node_index = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        const BvhNode& node = nodes[node_index];
+
+        if (node.is_leaf()) {
+            for (uint32_t i = 0; i < node.prim_count; ++i) {
+                if (intersect_prim(prim_indices[node.left_first + i], t_max)) {
+                    hit_anything = true;
+                }
+            }
+        }
+        else {
+            uint32_t near_index = node.left_first;
+            uint32_t far_index = node.left_first + 1;
+            float t_near, t_far;
+            bool hit_near = nodes[near_index].bounds.intersect(ray.origin, inv_dir, t_min, t_max, t_near);
+            bool hit_far = nodes[far_index].bounds.intersect(ray.origin, inv_dir, t_min, t_max, t_far);
+
+            // visit the closer child first so t_max shrinks as early as possible
+            if (hit_near && hit_far) {
+                if (t_far < t_near) std::swap(near_index, far_index);
+                if (stack_ptr < MAX_DEPTH) stack[stack_ptr++] = far_index;
+                node_index = near_index;
+                continue;
+            }
+            if (hit_near) { node_index = near_index; continue; }
+            if (hit_far) { node_index = far_index; continue; }
+        }
+
+        // pop, skipping anything that's now further than our closest hit
+        bool found = false;
+        while (stack_ptr > 0) {
+            node_index = stack[--stack_ptr];
+            if (nodes[node_index].bounds.intersect(ray.origin, inv_dir, t_min, t_max, t_entry)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) break;
+    }
+
+    return hit_anything;
+}
+
+template <typename IntersectPacket>
+bool Bvh::traverse_packet(RayPacket& packet, float t_min, IntersectPacket&& intersect_prim, uint64_t& node_visits) const
+{
+    if (nodes.empty() || none(packet.active)) return false;
+
+    float inv_lanes[3][PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; ++i) {
+        Vec3 inv = safe_inverse(Vec3(packet.dir_x[i], packet.dir_y[i], packet.dir_z[i]));
+        inv_lanes[0][i] = inv.x;
+        inv_lanes[1][i] = inv.y;
+        inv_lanes[2][i] = inv.z;
+    }
+    const Float4 inv_dir[3] = { Float4::load(inv_lanes[0]), Float4::load(inv_lanes[1]), Float4::load(inv_lanes[2]) };
+    const Float4 t_min4(t_min);
+
+    Float4 t_entry;
+    if (none(intersect_packet(nodes[0].bounds, packet, inv_dir, t_min4, t_entry))) return false;
+
+    uint32_t stack[MAX_DEPTH];
+    int stack_ptr = 0;
+    uint32_t node_index = 0;
+    bool hit_anything = false;
+    uint64_t visits = 0;
+
+    while (true) {
+        const BvhNode& node = nodes[node_index];
+        visits++;
+
+        if (node.is_leaf()) {
+            for (uint32_t i = 0; i < node.prim_count; ++i) {
+                if (intersect_prim(prim_indices[node.left_first + i], packet)) {
+                    hit_anything = true;
+                }
+            }
+        }
+        else {
+            uint32_t near_index = node.left_first;
+            uint32_t far_index = node.left_first + 1;
+            Float4 t_near, t_far;
+            Float4 mask_near = intersect_packet(nodes[near_index].bounds, packet, inv_dir, t_min4, t_near);
+            Float4 mask_far = intersect_packet(nodes[far_index].bounds, packet, inv_dir, t_min4, t_far);
+            bool hit_near = any(mask_near);
+            bool hit_far = any(mask_far);
+
+            // order on the closest entry of any lane, which is right for a coherent
+            // packet and merely suboptimal for an incoherent one
+            if (hit_near && hit_far) {
+                if (hmin(t_far, mask_far) < hmin(t_near, mask_near)) std::swap(near_index, far_index);
+                if (stack_ptr < MAX_DEPTH) stack[stack_ptr++] = far_index;
+                node_index = near_index;
+                continue;
+            }
+            if (hit_near) { node_index = near_index; continue; }
+            if (hit_far) { node_index = far_index; continue; }
+        }
+
+        // pop, skipping anything that's now further than every lane's closest hit
+        bool found = false;
+        while (stack_ptr > 0) {
+            node_index = stack[--stack_ptr];
+            if (any(intersect_packet(nodes[node_index].bounds, packet, inv_dir, t_min4, t_entry))) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) break;
+    }
+
+    node_visits += visits;
+    return hit_anything;
+}
+
+inline Float4 Bvh::intersect_packet(const Aabb& box, const RayPacket& packet, const Float4 inv_dir[3], const Float4& t_min, Float4& t_entry)
+{
+    Float4 tx1 = (Float4(box.min.x) - packet.origin_x) * inv_dir[0];
+    Float4 tx2 = (Float4(box.max.x) - packet.origin_x) * inv_dir[0];
+    Float4 t_near = vmin(tx1, tx2);
+    Float4 t_far = vmax(tx1, tx2);
+
+    Float4 ty1 = (Float4(box.min.y) - packet.origin_y) * inv_dir[1];
+    Float4 ty2 = (Float4(box.max.y) - packet.origin_y) * inv_dir[1];
+    t_near = vmax(t_near, vmin(ty1, ty2));
+    t_far = vmin(t_far, vmax(ty1, ty2));
+
+    Float4 tz1 = (Float4(box.min.z) - packet.origin_z) * inv_dir[2];
+    Float4 tz2 = (Float4(box.max.z) - packet.origin_z) * inv_dir[2];
+    t_near = vmax(t_near, vmin(tz1, tz2));
+    t_far = vmin(t_far, vmax(tz1, tz2));
+
+    t_entry = vmax(t_near, t_min);
+    return packet.active & (t_far >= t_entry) & (t_entry <= packet.t_max);
+}
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,112 @@
+#define NOMINMAX
+
+#include "bvh4.hpp"
+
+namespace ollygon {
+namespace okaytracer {
+
+void Bvh4::clear() {
+    nodes.clear();
+    leaves.clear();
+    prim_indices.clear();
+}
+
+void Bvh4::build(const Bvh& binary) {
+    clear();
+    if (binary.empty()) return;
+
+    const std::vector<BvhNode>& binary_nodes = binary.get_nodes();
+    prim_indices = binary.get_prim_indices();
+
+    // collapsing at least halves the interior node count
+    nodes.reserve(binary_nodes.size() / 2 + 1);
+    nodes.push_back(Bvh4Node());
+    for (int slot = 0; slot < 4; ++slot) {
+        set_child(0, slot, Aabb(), Bvh4Node::EMPTY, 0);
+    }
+
+    if (binary_nodes[0].is_leaf()) {
+        // whole scene fits in one leaf, still needs a node above it to traverse
+        leaves.push_back({ binary_nodes[0].left_first, binary_nodes[0].prim_count });
+        set_child(0, 0, binary_nodes[0].bounds, Bvh4Node::LEAF_FLAG | 0u, 0);
+        return;
+    }
+
+    collapse(0, 0, binary_nodes);
+}
+
+void Bvh4::collapse(uint32_t node_index, uint32_t binary_index, const std::vector<BvhNode>& binary_nodes) {
+    uint32_t children[4];
+    int num_children = 0;
+    children[num_children++] = binary_nodes[binary_index].left_first;
+    children[num_children++] = binary_nodes[binary_index].left_first + 1;
+
+    // keep opening up the biggest interior child, it's the one most rays will enter
+    while (num_children < 4) {
+        int best = -1;
+        float best_area = -1.0f;
+        for (int i = 0; i < num_children; ++i) {
+            const BvhNode& c = binary_nodes[children[i]];
+            if (c.is_leaf()) continue;
+            float area = c.bounds.surface_area();
+            if (area > best_area) {
+                best_area = area;
+                best = i;
+            }
+        }
+        if (best < 0) break;
+
+        uint32_t opened = children[best];
+        children[best] = binary_nodes[opened].left_first;
+        children[num_children++] = binary_nodes[opened].left_first + 1;
+    }
+
+    for (int slot = 0; slot < 4; ++slot) {
+        if (slot >= num_children) {
+            set_child(node_index, slot, Aabb(), Bvh4Node::EMPTY, 0);
+            continue;
+        }
+
+        const BvhNode& c = binary_nodes[children[slot]];
+        if (c.is_leaf()) {
+            uint32_t leaf_index = uint32_t(leaves.size());
+            leaves.push_back({ c.left_first, c.prim_count });
+            set_child(node_index, slot, c.bounds, Bvh4Node::LEAF_FLAG | leaf_index, children[slot]);
+        }
+        else {
+            // careful - no refs into nodes held over push_back
+            uint32_t child_index = uint32_t(nodes.size());
+            nodes.push_back(Bvh4Node());
+            set_child(node_index, slot, c.bounds, child_index, children[slot]);
+            collapse(child_index, children[slot], binary_nodes);
+        }
+    }
+}
+
+void Bvh4::refit(const Bvh& binary) {
+    // one pass over every slot, cheap next to the binary refit.  empty slots
+    // keep their empty box
+    const std::vector<BvhNode>& binary_nodes = binary.get_nodes();
+    for (uint32_t i = 0; i < uint32_t(nodes.size()); ++i) {
+        for (int slot = 0; slot < 4; ++slot) {
+            const uint32_t child = nodes[i].child[slot];
+            if (child == Bvh4Node::EMPTY) continue;
+            set_child(i, slot, binary_nodes[nodes[i].source[slot]].bounds, child, nodes[i].source[slot]);
+        }
+    }
+}
+
+void Bvh4::set_child(uint32_t node_index, int slot, const Aabb& bounds, uint32_t child, uint32_t source) {
+    Bvh4Node& node = nodes[node_index];
+    node.min_x[slot] = bounds.min.x;
+    node.min_y[slot] = bounds.min.y;
+    node.min_z[slot] = bounds.min.z;
+    node.max_x[slot] = bounds.max.x;
+    node.max_y[slot] = bounds.max.y;
+    node.max_z[slot] = bounds.max.z;
+    node.child[slot] = child;
+    node.source[slot] = source;
+}
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "simd.hpp"
+#include <vector>
+#include <cstdint>
+
+namespace ollygon {
+namespace okaytracer {
+
+// 4-wide node, child bounds stored SoA so one Float4 slab test covers all
+// four.  128 bytes, two cache lines
+struct alignas(16) Bvh4Node {
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+
+    // interior: index into nodes.  leaf: LEAF_FLAG | index into leaves.  unused: EMPTY
+    uint32_t child[4];
+    uint32_t source[4]; // binary node each child was collapsed from, for refit().  fills what was padding
+
+    static constexpr uint32_t LEAF_FLAG = 0x80000000u;
+    static constexpr uint32_t EMPTY = 0xFFFFFFFFu;
+
+    static bool is_leaf(uint32_t c) { return (c & LEAF_FLAG) != 0; }
+};
+
+struct Bvh4Leaf {
+    uint32_t first; // into prim_indices
+    uint32_t count;
+};
+
+// wide BVH made by collapsing a binary one, each node pulling up its
+// grandchildren until it has 4 children.  leaves keep the binary tree's prim
+// ranges, numbered so the caller can keep its own per-leaf data (eg prims
+// repacked for SIMD) in a parallel array
+class Bvh4 {
+public:
+    void build(const Bvh& binary);
+    void clear();
+
+    // copies bounds back over from the binary tree this was built from, after
+    // Bvh::refit().  the shapes must still match, ie no build() in between
+    void refit(const Bvh& binary);
+
+    bool empty() const { return nodes.empty(); }
+
+    const std::vector<Bvh4Node>& get_nodes() const { return nodes; }
+    const std::vector<Bvh4Leaf>& get_leaves() const { return leaves; }
+    const std::vector<uint32_t>& get_prim_indices() const { return prim_indices; }
+
+    // front-to-back closest hit traversal.  intersect_leaf(leaf_index, t_max) should
+    // return true on a hit closer than t_max and update t_max to the new hit distance.
+    // node_visits is added to, once per node and leaf gone into
+    template <typename IntersectLeaf>
+    bool traverse(const Ray& ray, float t_min, float& t_max, IntersectLeaf&& intersect_leaf, uint64_t& node_visits) const;
+
+    // any-hit query for shadow rays, stops at the first leaf that reports a hit.
+    // occluded_leaf(leaf_index, t_max) returns true if anything in it is hit before t_max
+    template <typename OccludedLeaf>
+    bool occluded(const Ray& ray, float t_min, float t_max, OccludedLeaf&& occluded_leaf, uint64_t& node_visits) const;
+
+private:
+    struct RayLanes {
+        Float4 origin_x, origin_y, origin_z;
+        Float4 inv_x, inv_y, inv_z;
+        Float4 t_min;
+
+        explicit RayLanes(const Ray& ray, float _t_min);
+    };
+
+    // slab test of one ray against all four children, returns the hit mask
+    static int intersect_children(const Bvh4Node& node, const RayLanes& lanes, float t_max, Float4& t_entry);
+
+    void collapse(uint32_t node_index, uint32_t binary_index, const std::vector<BvhNode>& binary_nodes);
+    void set_child(uint32_t node_index, int slot, const Aabb& bounds, uint32_t child, uint32_t source);
+
+    std::vector<Bvh4Node> nodes;
+    std::vector<Bvh4Leaf> leaves;
+    std::vector<uint32_t> prim_indices;
+
+    // each level pops one entry and pushes at most four
+    static constexpr int STACK_SIZE = 256;
+};
+
+template <typename IntersectLeaf>
+bool Bvh4::traverse(const Ray& ray, float t_min, float& t_max, IntersectLeaf&& intersect_leaf, uint64_t& node_visits) const
+{
+    if (nodes.empty()) return false;
+
+    const RayLanes lanes(ray, t_min);
+
+    struct StackEntry {
+        uint32_t child;
+        float t_entry; // so stale entries can be dropped without retesting the box
+    };
+    StackEntry stack[STACK_SIZE];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = { 0, t_min };
+
+    bool hit_anything = false;
+    uint64_t visits = 0; // kept local so the loop isn't writing through a reference
+
+    while (stack_ptr > 0) {
+        const StackEntry entry = stack[--stack_ptr];
+        if (entry.t_entry > t_max) continue;
+
+        visits++;
+        if (Bvh4Node::is_leaf(entry.child)) {
+            if (intersect_leaf(entry.child & ~Bvh4Node::LEAF_FLAG, t_max)) {
+                hit_anything = true;
+            }
+            continue;
+        }
+
+        const Bvh4Node& node = nodes[entry.child];
+
+        Float4 t_entry;
+        int hits = intersect_children(node, lanes, t_max, t_entry);
+        if (hits == 0) continue;
+
+        float t_entries[4];
+        t_entry.store(t_entries);
+
+        // insertion sort the hit children far to near, then push in that order
+        // so the nearest ends up on top of the stack
+        StackEntry sorted[4];
+        int num_sorted = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (!(hits & (1 << i)) || node.child[i] == Bvh4Node::EMPTY) continue;
+            StackEntry e = { node.child[i], t_entries[i] };
+            int j = num_sorted++;
+            while (j > 0 && sorted[j - 1].t_entry < e.t_entry) {
+                sorted[j] = sorted[j - 1];
+                --j;
+            }
+            sorted[j] = e;
+        }
+        for (int i = 0; i < num_sorted && stack_ptr < STACK_SIZE; ++i) {
+            stack[stack_ptr++] = sorted[i];
+        }
+    }
+
+    node_visits += visits;
+    return hit_anything;
+}
+
+template <typename OccludedLeaf>
+bool Bvh4::occluded(const Ray& ray, float t_min, float t_max, OccludedLeaf&& occluded_leaf, uint64_t& node_visits) const
+{
+    if (nodes.empty()) return false;
+
+    const RayLanes lanes(ray, t_min);
+
+    // order doesn't matter for any-hit, so no sorting or entry distances
+    uint32_t stack[STACK_SIZE];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = 0;
+    uint64_t visits = 0;
+
+    while (stack_ptr > 0) {
+        const uint32_t child = stack[--stack_ptr];
+
+        visits++;
+        if (Bvh4Node::is_leaf(child)) {
+            if (occluded_leaf(child & ~Bvh4Node::LEAF_FLAG, t_max)) {
+                node_visits += visits;
+                return true;
+            }
+            continue;
+        }
+
+        const Bvh4Node& node = nodes[child];
+        Float4 t_entry;
+        int hits = intersect_children(node, lanes, t_max, t_entry);
+
+        for (int i = 0; i < 4 && stack_ptr < STACK_SIZE; ++i) {
+            if ((hits & (1 << i)) && node.child[i] != Bvh4Node::EMPTY) {
+                stack[stack_ptr++] = node.child[i];
+            }
+        }
+    }
+
+    node_visits += visits;
+    return false;
+}
+
+inline Bvh4::RayLanes::RayLanes(const Ray& ray, float _t_min)
+    : origin_x(ray.origin.x), origin_y(ray.origin.y), origin_z(ray.origin.z)
+    , t_min(_t_min)
+{
+    const Vec3 inv = Bvh::safe_inverse(ray.direction);
+    inv_x = Float4(inv.x);
+    inv_y = Float4(inv.y);
+    inv_z = Float4(inv.z);
+}
+
+inline int Bvh4::intersect_children(const Bvh4Node& node, const RayLanes& lanes, float t_max, Float4& t_entry)
+{
+    Float4 tx1 = (Float4::load(node.min_x) - lanes.origin_x) * lanes.inv_x;
+    Float4 tx2 = (Float4::load(node.max_x) - lanes.origin_x) * lanes.inv_x;
+    Float4 t_near = vmin(tx1, tx2);
+    Float4 t_far = vmax(tx1, tx2);
+
+    Float4 ty1 = (Float4::load(node.min_y) - lanes.origin_y) * lanes.inv_y;
+    Float4 ty2 = (Float4::load(node.max_y) - lanes.origin_y) * lanes.inv_y;
+    t_near = vmax(t_near, vmin(ty1, ty2));
+    t_far = vmin(t_far, vmax(ty1, ty2));
+
+    Float4 tz1 = (Float4::load(node.min_z) - lanes.origin_z) * lanes.inv_z;
+    Float4 tz2 = (Float4::load(node.max_z) - lanes.origin_z) * lanes.inv_z;
+    t_near = vmax(t_near, vmin(tz1, tz2));
+    t_far = vmin(t_far, vmax(tz1, tz2));
+
+    t_entry = vmax(t_near, lanes.t_min);
+    return movemask((t_far >= t_entry) & (t_entry <= Float4(t_max)));
+}
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,228 @@
+#define NOMINMAX
+
+#include "denoiser.hpp"
+#include "simd.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace ollygon {
+namespace okaytracer {
+
+namespace {
+
+// B3 spline, the standard a-trous kernel
+constexpr float KERNEL[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+constexpr int ROWS_PER_TASK = 8;
+
+// dividing by ~0 albedo would blow up noise, such pixels are filtered as-is
+constexpr float MIN_ALBEDO = 0.01f;
+
+float demodulator(float albedo) {
+    return albedo > MIN_ALBEDO ? albedo : 1.0f;
+}
+
+float luminance(float r, float g, float b) {
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+Float4 luminance(const Float4& r, const Float4& g, const Float4& b) {
+    return r * Float4(0.2126f) + g * Float4(0.7152f) + b * Float4(0.0722f);
+}
+
+// 4 consecutive pixels from a plane starting at x, lanes outside [0, width)
+// are clamped in and it's up to the caller to mask them
+Float4 load_row(const float* row, int x, int width) {
+    if (x >= 0 && x + 3 < width) {
+        return Float4::load(row + x);
+    }
+    float lanes[4];
+    for (int i = 0; i < 4; ++i) {
+        lanes[i] = row[std::min(std::max(x + i, 0), width - 1)];
+    }
+    return Float4::load(lanes);
+}
+
+// mask of lanes x..x+3 that land inside [0, width)
+Float4 lanes_inside(int x, int width) {
+    if (x >= 0 && x + 3 < width) return all_lanes();
+    return Float4(
+        (x + 0 >= 0 && x + 0 < width) ? 1.0f : 0.0f,
+        (x + 1 >= 0 && x + 1 < width) ? 1.0f : 0.0f,
+        (x + 2 >= 0 && x + 2 < width) ? 1.0f : 0.0f,
+        (x + 3 >= 0 && x + 3 < width) ? 1.0f : 0.0f
+    ) > Float4(0.0f);
+}
+
+} // namespace
+
+void Denoiser::denoise(int width, int height,
+    DenoiseChannels beauty, DenoiseChannels albedo, DenoiseChannels normal, DenoiseChannels depth,
+    DenoiseChannels variance, ThreadPool& pool, std::vector<float>& out)
+{
+    const int num_pixels = width * height;
+    out.resize(size_t(num_pixels) * 3);
+    if (num_pixels == 0) return;
+
+    for (auto& plane : planes) {
+        plane.resize(num_pixels);
+    }
+
+    const int num_tasks = (height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+
+    // == split into planes, demodulating albedo ==
+    pool.parallel_for(num_tasks, [&](int task) {
+        int y_end = std::min((task + 1) * ROWS_PER_TASK, height);
+        for (int i = task * ROWS_PER_TASK * width; i < y_end * width; ++i) {
+            const float* b = beauty.data + size_t(i) * beauty.stride;
+            const float* a = albedo.data + size_t(i) * albedo.stride;
+            const float* n = normal.data + size_t(i) * normal.stride;
+
+            planes[AlbedoR][i] = a[0];
+            planes[AlbedoG][i] = a[1];
+            planes[AlbedoB][i] = a[2];
+            const float dr = demodulator(a[0]), dg = demodulator(a[1]), db = demodulator(a[2]);
+            planes[ColourR][i] = b[0] / dr;
+            planes[ColourG][i] = b[1] / dg;
+            planes[ColourB][i] = b[2] / db;
+
+            // near enough, treating the demodulation as a single grey scale
+            const float dl = luminance(dr, dg, db);
+            planes[Variance][i] = variance.data[size_t(i) * variance.stride] / (dl * dl);
+
+            planes[NormalX][i] = n[0];
+            planes[NormalY][i] = n[1];
+            planes[NormalZ][i] = n[2];
+            planes[Depth][i] = depth.data[size_t(i) * depth.stride];
+        }
+    });
+
+    // == filter ==
+    for (int iteration = 0; iteration < settings.iterations; ++iteration) {
+        const int step = 1 << iteration;
+        pool.parallel_for(num_tasks, [&](int task) {
+            filter_pass(width, height, step, task * ROWS_PER_TASK, std::min((task + 1) * ROWS_PER_TASK, height));
+        });
+
+        planes[ColourR].swap(planes[OutR]);
+        planes[ColourG].swap(planes[OutG]);
+        planes[ColourB].swap(planes[OutB]);
+        planes[Variance].swap(planes[OutVariance]);
+    }
+
+    // == remodulate, back to interleaved ==
+    pool.parallel_for(num_tasks, [&](int task) {
+        int y_end = std::min((task + 1) * ROWS_PER_TASK, height);
+        for (int i = task * ROWS_PER_TASK * width; i < y_end * width; ++i) {
+            out[size_t(i) * 3 + 0] = planes[ColourR][i] * demodulator(planes[AlbedoR][i]);
+            out[size_t(i) * 3 + 1] = planes[ColourG][i] * demodulator(planes[AlbedoG][i]);
+            out[size_t(i) * 3 + 2] = planes[ColourB][i] * demodulator(planes[AlbedoB][i]);
+        }
+    });
+}
+
+void Denoiser::filter_pass(int width, int height, int step, int y_begin, int y_end)
+{
+    // every edge-stopping term goes into one exponent, so it's a single vexp per tap
+    const Float4 sigma_luminance(settings.sigma_luminance);
+    const Float4 min_sigma(1e-4f);
+    const Float4 inv_sigma_normal_sq(1.0f / (settings.sigma_normal * settings.sigma_normal));
+    const Float4 inv_sigma_albedo_sq(1.0f / (settings.sigma_albedo * settings.sigma_albedo));
+    const Float4 min_depth(1e-3f);
+    const Float4 zero(0.0f);
+
+    for (int y = y_begin; y < y_end; ++y) {
+        const int row = y * width;
+
+        for (int x = 0; x < width; x += 4) {
+            const Float4 inside = lanes_inside(x, width);
+
+            const Float4 cr = load_row(&planes[ColourR][row], x, width);
+            const Float4 cg = load_row(&planes[ColourG][row], x, width);
+            const Float4 cb = load_row(&planes[ColourB][row], x, width);
+            const Float4 nx = load_row(&planes[NormalX][row], x, width);
+            const Float4 ny = load_row(&planes[NormalY][row], x, width);
+            const Float4 nz = load_row(&planes[NormalZ][row], x, width);
+            const Float4 ar = load_row(&planes[AlbedoR][row], x, width);
+            const Float4 ag = load_row(&planes[AlbedoG][row], x, width);
+            const Float4 ab = load_row(&planes[AlbedoB][row], x, width);
+            const Float4 z = load_row(&planes[Depth][row], x, width);
+            const Float4 var = load_row(&planes[Variance][row], x, width);
+
+            const Float4 lum = luminance(cr, cg, cb);
+            const Float4 inv_depth = Float4(1.0f) / (vmax(z, min_depth) * Float4(settings.sigma_depth));
+
+            Float4 sum_r, sum_g, sum_b, sum_w, sum_var;
+
+            for (int ky = -2; ky <= 2; ++ky) {
+                const int yy = y + ky * step;
+                if (yy < 0 || yy >= height) continue;
+                const int tap_row = yy * width;
+
+                for (int kx = -2; kx <= 2; ++kx) {
+                    const int xx = x + kx * step;
+                    const Float4 tap_inside = lanes_inside(xx, width);
+
+                    const Float4 qr = load_row(&planes[ColourR][tap_row], xx, width);
+                    const Float4 qg = load_row(&planes[ColourG][tap_row], xx, width);
+                    const Float4 qb = load_row(&planes[ColourB][tap_row], xx, width);
+                    const Float4 q_var = load_row(&planes[Variance][tap_row], xx, width);
+
+                    Float4 exponent;
+                    if (kx != 0 || ky != 0) {
+                        // a luminance step only counts as an edge if it's well outside the noise of
+                        // the difference.  judging it by the centre's noise alone would be lopsided:
+                        // a bright noisy tap gets through to a quiet dark pixel but not the other way
+                        // round, so energy leaks out of every bright region
+                        const Float4 sigma_lum = sigma_luminance * vsqrt(vmax(var + q_var, zero)) + min_sigma;
+                        exponent = vabs(luminance(qr, qg, qb) - lum) / sigma_lum;
+
+                        const Float4 dnx = load_row(&planes[NormalX][tap_row], xx, width) - nx;
+                        const Float4 dny = load_row(&planes[NormalY][tap_row], xx, width) - ny;
+                        const Float4 dnz = load_row(&planes[NormalZ][tap_row], xx, width) - nz;
+                        exponent = exponent + (dnx * dnx + dny * dny + dnz * dnz) * inv_sigma_normal_sq;
+
+                        const Float4 dar = load_row(&planes[AlbedoR][tap_row], xx, width) - ar;
+                        const Float4 dag = load_row(&planes[AlbedoG][tap_row], xx, width) - ag;
+                        const Float4 dab = load_row(&planes[AlbedoB][tap_row], xx, width) - ab;
+                        exponent = exponent + (dar * dar + dag * dag + dab * dab) * inv_sigma_albedo_sq;
+
+                        // depth naturally drifts further apart the further out the tap is
+                        const float tap_distance = float(step) * std::sqrt(float(kx * kx + ky * ky));
+                        const Float4 dz = vabs(load_row(&planes[Depth][tap_row], xx, width) - z);
+                        exponent = exponent + dz * inv_depth / Float4(tap_distance);
+                    }
+
+                    const Float4 weight = (Float4(KERNEL[kx + 2] * KERNEL[ky + 2]) * vexp(zero - exponent)) & tap_inside;
+
+                    sum_r = sum_r + qr * weight;
+                    sum_g = sum_g + qg * weight;
+                    sum_b = sum_b + qb * weight;
+                    sum_w = sum_w + weight;
+                    // the output is a weighted mean, so its variance goes with the squared weights
+                    sum_var = sum_var + q_var * weight * weight;
+                }
+            }
+
+            // centre tap always counts, so sum_w > 0 for every lane inside the image
+            const Float4 inv_w = Float4(1.0f) / select(inside, sum_w, Float4(1.0f));
+            float out_r[4], out_g[4], out_b[4], out_var[4];
+            (sum_r * inv_w).store(out_r);
+            (sum_g * inv_w).store(out_g);
+            (sum_b * inv_w).store(out_b);
+            (sum_var * inv_w * inv_w).store(out_var);
+
+            const int lanes = std::min(4, width - x);
+            for (int i = 0; i < lanes; ++i) {
+                planes[OutR][row + x + i] = out_r[i];
+                planes[OutG][row + x + i] = out_g[i];
+                planes[OutB][row + x + i] = out_b[i];
+                planes[OutVariance][row + x + i] = out_var[i];
+            }
+        }
+    }
+}
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include <vector>
+
+namespace ollygon {
+namespace okaytracer {
+
+// strided view of one interleaved buffer, eg the rgb of the beauty
+struct DenoiseChannels {
+    const float* data;
+    int stride; // floats between consecutive pixels
+};
+
+// edge-avoiding a-trous wavelet filter (Dammertz et al. 2010), with SVGF's
+// variance-guided luminance weights.  the beauty is divided through by albedo
+// first so texture survives, filtered with a widening 5x5 kernel whose taps are
+// weighted down across luminance, normal, depth and albedo edges, then
+// multiplied back up.  luminance differences are judged against the two pixels'
+// combined sampling noise, so noisy pixels (fireflies included) get smoothed hard while
+// converged edges stay put.  cheap enough to run on every preview
+class Denoiser {
+public:
+    struct Settings {
+        int iterations;      // kernel footprint is 4 * 2^iterations pixels
+        float sigma_luminance; // in standard deviations of the two pixels' combined noise
+        float sigma_normal;
+        float sigma_depth;   // relative to the centre pixel's depth, per pixel of tap distance
+        float sigma_albedo;
+
+        Settings()
+            : iterations(5)
+            , sigma_luminance(4.0f)
+            , sigma_normal(0.3f)
+            , sigma_depth(0.02f)
+            , sigma_albedo(0.1f)
+        {}
+    };
+
+    // beauty and albedo are rgb, normal xyz, depth one channel.  variance is of the
+    // beauty's luminance, as an estimate of the mean (ie already divided by sample count).
+    // writes rgb interleaved
+    void denoise(int width, int height,
+        DenoiseChannels beauty, DenoiseChannels albedo, DenoiseChannels normal, DenoiseChannels depth,
+        DenoiseChannels variance, ThreadPool& pool, std::vector<float>& out);
+
+    Settings settings;
+
+private:
+    void filter_pass(int width, int height, int step, int y_begin, int y_end);
+
+    // planar scratch, kept between calls
+    enum Plane {
+        ColourR, ColourG, ColourB, Variance,  // read this pass
+        OutR, OutG, OutB, OutVariance,        // written this pass, then swapped
+        AlbedoR, AlbedoG, AlbedoB,
+        NormalX, NormalY, NormalZ,
+        Depth,
+        PlaneCount
+    };
+    std::vector<float> planes[PlaneCount];
+};
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -447,16 +447,43 @@ void OptixBackend::build_scene(const RenderScene& scene)
         d_gas_output_buffer = 0;
         gas_handle = 0;
     }
-    // convert to gpu-compatible format
+    // convert to gpu-compatible format.  GAS prim index == index in this array,
+    // analytic prims first then every mesh tri (instances' included) expanded back out
     std::vector<GpuRenderPrimitive> gpu_primitives;
-    gpu_primitives.reserve(scene.primitives.size());
+    std::vector<OptixAabb> aabbs;
+    gpu_primitives.reserve(scene.primitives.size() + scene.triangles.size());
+    aabbs.reserve(scene.primitives.size() + scene.triangles.size());
+
+    // the kernels still embed the material per-prim, so resolve ids from the table here
     for (const auto& prim : scene.primitives) {
-        gpu_primitives.push_back(to_gpu_primitive(prim));
+        gpu_primitives.push_back(to_gpu_primitive(prim, scene.materials[prim.material_id]));
+        aabbs.push_back(to_optix_aabb(prim.bounds()));
+    }
+    for (const auto& tri : scene.triangles) {
+        const RenderMesh& mesh = scene.meshes[tri.mesh_id];
+        gpu_primitives.push_back(to_gpu_triangle(mesh, tri.tri_index, scene.materials[mesh.material_id]));
+        aabbs.push_back(to_optix_aabb(scene.triangle_bounds(tri)));
+    }
+    // no IAS yet, so instances get baked back out to world space tris
+    for (const auto& instance : scene.instances) {
+        const RenderMesh mesh = scene.bake_instance(instance);
+        for (uint32_t i = 0; i < uint32_t(mesh.indices.size() / 3); ++i) {
+            const uint32_t* idx = &mesh.indices[i * 3];
+            Aabb box;
+            box.expand(mesh.positions[idx[0]]);
+            box.expand(mesh.positions[idx[1]]);
+            box.expand(mesh.positions[idx[2]]);
+
+            gpu_primitives.push_back(to_gpu_triangle(mesh, i, scene.materials[mesh.material_id]));
+            aabbs.push_back(to_optix_aabb(box));
+        }
     }
+
     // copy gpu prims to device
     size_t prim_bytes = gpu_primitives.size() * sizeof(GpuRenderPrimitive);
     if (d_primitives) {
         CUDA_CHECK(cudaFree((void*)d_primitives));
+        d_primitives = 0;
     }
     if (prim_bytes > 0) {
         CUDA_CHECK(cudaMalloc((void**)&d_primitives, prim_bytes));
@@ -470,65 +497,11 @@ void OptixBackend::build_scene(const RenderScene& scene)
     params.primitives = (GpuRenderPrimitive*)d_primitives;
     params.primitive_count = static_cast<int>(gpu_primitives.size());
 
-    if (scene.primitives.empty()) {
+    if (gpu_primitives.empty()) {
         params.handle = 0; // empty scene
         return;
     }
 
-    // build custom aabbs for the ollygon prims
-    std::vector<OptixAabb> aabbs;
-    aabbs.reserve(scene.primitives.size());
-
-    for (const auto& prim : scene.primitives) {
-        OptixAabb aabb;
-
-        switch (prim.type) {
-        case RenderPrimitive::Type::Sphere: {
-            aabb.minX = prim.centre.x - prim.radius;
-            aabb.minY = prim.centre.y - prim.radius;
-            aabb.minZ = prim.centre.z - prim.radius;
-            aabb.maxX = prim.centre.x + prim.radius;
-            aabb.maxY = prim.centre.y + prim.radius;
-            aabb.maxZ = prim.centre.z + prim.radius;
-            break;
-        }
-        case RenderPrimitive::Type::Quad: {
-            Vec3 corners[4] = {
-                prim.quad_corner,
-                prim.quad_corner + prim.quad_u,
-                prim.quad_corner + prim.quad_v,
-                prim.quad_corner + prim.quad_u + prim.quad_v
-            };
-
-            aabb.minX = aabb.maxX = corners[0].x;
-            aabb.minY = aabb.maxY = corners[0].y;
-            aabb.minZ = aabb.maxZ = corners[0].z;
-
-            for (int i = 1; i < 4; i++) {
-                aabb.minX = std::fmin(aabb.minX, corners[i].x);
-                aabb.minY = std::fmin(aabb.minY, corners[i].y);
-                aabb.minZ = std::fmin(aabb.minZ, corners[i].z);
-                aabb.maxX = std::fmax(aabb.maxX, corners[i].x);
-                aabb.maxY = std::fmax(aabb.maxY, corners[i].y);
-                aabb.maxZ = std::fmax(aabb.maxZ, corners[i].z);
-            }
-            break;
-        }
-        case RenderPrimitive::Type::Triangle: {
-            // std::fmin/fmax only take 2 args so have to nest them
-            aabb.minX = std::fmin(prim.tri_v0.x, std::fmin(prim.tri_v1.x, prim.tri_v2.x));
-            aabb.minY = std::fmin(prim.tri_v0.y, std::fmin(prim.tri_v1.y, prim.tri_v2.y));
-            aabb.minZ = std::fmin(prim.tri_v0.z, std::fmin(prim.tri_v1.z, prim.tri_v2.z));
-            aabb.maxX = std::fmax(prim.tri_v0.x, std::fmax(prim.tri_v1.x, prim.tri_v2.x));
-            aabb.maxY = std::fmax(prim.tri_v0.y, std::fmax(prim.tri_v1.y, prim.tri_v2.y));
-            aabb.maxZ = std::fmax(prim.tri_v0.z, std::fmax(prim.tri_v1.z, prim.tri_v2.z));
-            break;
-        }
-        }
-
-        aabbs.push_back(aabb);
-    }
-
     // upload the aabbs to gpu
     CUdeviceptr d_aabbs;
     size_t aabb_bytes = aabbs.size() * sizeof(OptixAabb);
@@ -597,7 +570,7 @@ void OptixBackend::build_scene(const RenderScene& scene)
 
     params.handle = gas_handle;
 
-    std::cout << "GAS built with " << scene.primitives.size() << " primitives\n";
+    std::cout << "GAS built with " << gpu_primitives.size() << " primitives\n";
 
     //other non-primitive things. just sky for now:
     params.sky = to_gpu_sky(scene.sky);
@@ -741,8 +714,8 @@ GpuMaterial OptixBackend::to_gpu_material(const Material& mat) {
     return gpu_mat;
 }
 
-GpuRenderPrimitive OptixBackend::to_gpu_primitive(const RenderPrimitive& prim) {
-    GpuRenderPrimitive gpu_prim;
+GpuRenderPrimitive OptixBackend::to_gpu_primitive(const RenderPrimitive& prim, const Material& mat) {
+    GpuRenderPrimitive gpu_prim = {};
 
     switch (prim.type) {
     case RenderPrimitive::Type::Sphere:
@@ -751,8 +724,7 @@ GpuRenderPrimitive OptixBackend::to_gpu_primitive(const RenderPrimitive& prim) {
     case RenderPrimitive::Type::Quad:
         gpu_prim.type = GpuPrimitiveType::Quad;
         break;
-    case RenderPrimitive::Type::Triangle:
-        gpu_prim.type = GpuPrimitiveType::Triangle;
+    default:
         break;
     }
 
@@ -762,17 +734,38 @@ GpuRenderPrimitive OptixBackend::to_gpu_primitive(const RenderPrimitive& prim) {
     gpu_prim.quad_u = to_gpu_vec3(prim.quad_u);
     gpu_prim.quad_v = to_gpu_vec3(prim.quad_v);
     gpu_prim.quad_normal = to_gpu_vec3(prim.quad_normal);
-    gpu_prim.tri_v0 = to_gpu_vec3(prim.tri_v0);
-    gpu_prim.tri_v1 = to_gpu_vec3(prim.tri_v1);
-    gpu_prim.tri_v2 = to_gpu_vec3(prim.tri_v2);
-    gpu_prim.tri_n0 = to_gpu_vec3(prim.tri_n0);
-    gpu_prim.tri_n1 = to_gpu_vec3(prim.tri_n1);
-    gpu_prim.tri_n2 = to_gpu_vec3(prim.tri_n2);
-    gpu_prim.material = to_gpu_material(prim.material);
+    gpu_prim.material = to_gpu_material(mat);
 
     return gpu_prim;
 }
 
+GpuRenderPrimitive OptixBackend::to_gpu_triangle(const RenderMesh& mesh, uint32_t tri_index, const Material& mat) {
+    GpuRenderPrimitive gpu_prim = {};
+    gpu_prim.type = GpuPrimitiveType::Triangle;
+
+    const uint32_t* idx = &mesh.indices[tri_index * 3];
+    gpu_prim.tri_v0 = to_gpu_vec3(mesh.positions[idx[0]]);
+    gpu_prim.tri_v1 = to_gpu_vec3(mesh.positions[idx[1]]);
+    gpu_prim.tri_v2 = to_gpu_vec3(mesh.positions[idx[2]]);
+    gpu_prim.tri_n0 = to_gpu_vec3(mesh.normals[idx[0]]);
+    gpu_prim.tri_n1 = to_gpu_vec3(mesh.normals[idx[1]]);
+    gpu_prim.tri_n2 = to_gpu_vec3(mesh.normals[idx[2]]);
+    gpu_prim.material = to_gpu_material(mat);
+
+    return gpu_prim;
+}
+
+OptixAabb OptixBackend::to_optix_aabb(const Aabb& box) {
+    OptixAabb aabb;
+    aabb.minX = box.min.x;
+    aabb.minY = box.min.y;
+    aabb.minZ = box.min.z;
+    aabb.maxX = box.max.x;
+    aabb.maxY = box.max.y;
+    aabb.maxZ = box.max.z;
+    return aabb;
+}
+
 GpuSky OptixBackend::to_gpu_sky(const Sky& sky) {
     GpuSky gpu_sky;
     gpu_sky.colour_bottom = to_gpu_colour(sky.colour_bottom);
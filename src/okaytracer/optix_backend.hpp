@@ -71,7 +71,9 @@ private:
     GpuVec3 to_gpu_vec3(const Vec3& v);
     GpuColour to_gpu_colour(const Colour& c);
     GpuMaterial to_gpu_material(const Material& mat);
-    GpuRenderPrimitive to_gpu_primitive(const RenderPrimitive& prim);
+    GpuRenderPrimitive to_gpu_primitive(const RenderPrimitive& prim, const Material& mat);
+    GpuRenderPrimitive to_gpu_triangle(const RenderMesh& mesh, uint32_t tri_index, const Material& mat);
+    OptixAabb to_optix_aabb(const Aabb& box);
     GpuSky to_gpu_sky(const Sky& sky);
 
     OptixDeviceContext context;
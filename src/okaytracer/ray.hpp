@@ -2,7 +2,7 @@
 
 #include "../core/vec3.hpp"
 #include "../core/colour.hpp"
-#include "../core/material.hpp"
+#include <cstdint>
 
 namespace ollygon {
 namespace okaytracer {
@@ -25,9 +25,10 @@ struct Intersection { // bit better naming than HitRecord I think
     float t; //distance, as in t used in lerps. convention in pbrt/shirley
     bool front_face;
 
-    Material material;
+    uint32_t material_id; // into RenderScene::materials
+    uint32_t prim_id;     // bvh item, ie into RenderScene::primitives then triangles then instances
 
-    Intersection() : t(0), front_face(true) {}
+    Intersection() : t(0), front_face(true), material_id(0), prim_id(0) {}
 
     // sets normal to always point against ray
     void set_face_normal(const Ray& ray, const Vec3& outward_normal) {
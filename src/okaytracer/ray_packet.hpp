@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ray.hpp"
+#include "simd.hpp"
+#include <cstdint>
+
+namespace ollygon {
+namespace okaytracer {
+
+constexpr int PACKET_SIZE = 4;
+constexpr uint32_t NO_HIT = 0xFFFFFFFFu;
+
+// 4 Vec3s, SoA.  lanes are rays in a packet, or prims tested against one ray
+struct Vec3x4 {
+    Float4 x, y, z;
+
+    Vec3x4() {}
+    Vec3x4(const Float4& _x, const Float4& _y, const Float4& _z) : x(_x), y(_y), z(_z) {}
+    explicit Vec3x4(const Vec3& v) : x(v.x), y(v.y), z(v.z) {}
+
+    Vec3x4 operator+(const Vec3x4& o) const { return Vec3x4(x + o.x, y + o.y, z + o.z); }
+    Vec3x4 operator-(const Vec3x4& o) const { return Vec3x4(x - o.x, y - o.y, z - o.z); }
+    Vec3x4 operator*(const Float4& s) const { return Vec3x4(x * s, y * s, z * s); }
+
+    static Float4 dot(const Vec3x4& a, const Vec3x4& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    static Vec3x4 cross(const Vec3x4& a, const Vec3x4& b) {
+        return Vec3x4(
+            a.y * b.z - a.z * b.y,
+            a.z * b.x - a.x * b.z,
+            a.x * b.y - a.y * b.x
+        );
+    }
+};
+
+// 4 rays in SoA form, traced together through the BVH.  only worth it when the
+// rays are coherent, ie camera rays from a 2x2 pixel block
+struct RayPacket {
+    Float4 origin_x, origin_y, origin_z;
+    Float4 dir_x, dir_y, dir_z;
+
+    Float4 t_max;  // closest hit so far, per lane
+    Float4 active; // lane mask, unused lanes never hit anything
+
+    uint32_t hit_item[PACKET_SIZE]; // bvh prim index of closest hit, or NO_HIT
+
+    // count <= PACKET_SIZE, any lanes past count are left inactive
+    RayPacket(const Ray* rays, int count, float _t_max) {
+        float ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+        float dx[PACKET_SIZE], dy[PACKET_SIZE], dz[PACKET_SIZE];
+        float lane_active[PACKET_SIZE];
+
+        for (int i = 0; i < PACKET_SIZE; ++i) {
+            // inactive lanes duplicate lane 0 so they can't produce NaNs of their own
+            const Ray& r = rays[i < count ? i : 0];
+
+            ox[i] = r.origin.x; oy[i] = r.origin.y; oz[i] = r.origin.z;
+            dx[i] = r.direction.x; dy[i] = r.direction.y; dz[i] = r.direction.z;
+            lane_active[i] = i < count ? 1.0f : 0.0f;
+
+            hit_item[i] = NO_HIT;
+        }
+
+        origin_x = Float4::load(ox); origin_y = Float4::load(oy); origin_z = Float4::load(oz);
+        dir_x = Float4::load(dx); dir_y = Float4::load(dy); dir_z = Float4::load(dz);
+
+        t_max = Float4(_t_max);
+        active = Float4::load(lane_active) > Float4(0.0f);
+    }
+
+    // lanes in hit_mask take t as their new closest hit on item
+    void record_hits(const Float4& hit_mask, const Float4& t, uint32_t item) {
+        t_max = select(hit_mask, t, t_max);
+        int bits = movemask(hit_mask);
+        for (int i = 0; i < PACKET_SIZE; ++i) {
+            if (bits & (1 << i)) hit_item[i] = item;
+        }
+    }
+};
+
+} // namespace okaytracer
+} // namespace ollygon
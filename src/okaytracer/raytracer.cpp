@@ -5,21 +5,139 @@
 #include <cmath>
 #include <algorithm>
 #include <limits>
+#include <numeric>
 #include <iostream>
 
 namespace ollygon {
 namespace okaytracer {
 
-Raytracer::Raytracer()
+namespace {
+
+float luminance(float r, float g, float b) {
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+// veach's power heuristic, beta = 2
+float power_heuristic(float pdf_a, float pdf_b) {
+    float a = pdf_a * pdf_a;
+    float b = pdf_b * pdf_b;
+    return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
+
+// box around a box after an affine transform, ie around its 8 transformed corners
+Aabb transform_bounds(const Aabb& box, const Mat4& transform) {
+    Aabb out;
+    for (int corner = 0; corner < 8; ++corner) {
+        out.expand(transform.transform_point(Vec3(
+            (corner & 1) ? box.max.x : box.min.x,
+            (corner & 2) ? box.max.y : box.min.y,
+            (corner & 4) ? box.max.z : box.min.z)));
+    }
+    return out;
+}
+
+// fills TriangleBlock4s 4 tris at a time, padding the last with degenerate lanes
+class TriangleBlockPacker {
+public:
+    explicit TriangleBlockPacker(std::vector<TriangleBlock4>& _blocks) : blocks(_blocks) {}
+
+    // id is what the block records for the tri, see TriangleBlock4::triangle
+    void add(const RenderMesh& mesh, uint32_t tri_index, uint32_t id) {
+        const uint32_t* idx = &mesh.indices[tri_index * 3];
+        const Vec3& v0 = mesh.positions[idx[0]];
+        Vec3 edge1 = mesh.positions[idx[1]] - v0;
+        Vec3 edge2 = mesh.positions[idx[2]] - v0;
+
+        lanes[0][lane] = v0.x; lanes[1][lane] = v0.y; lanes[2][lane] = v0.z;
+        lanes[3][lane] = edge1.x; lanes[4][lane] = edge1.y; lanes[5][lane] = edge1.z;
+        lanes[6][lane] = edge2.x; lanes[7][lane] = edge2.y; lanes[8][lane] = edge2.z;
+        lane_tris[lane] = id;
+
+        if (++lane == 4) flush();
+    }
+
+    void finish() {
+        if (lane > 0) flush();
+    }
+
+private:
+    void flush() {
+        TriangleBlock4 block;
+        block.v0_x = Float4::load(lanes[0]); block.v0_y = Float4::load(lanes[1]); block.v0_z = Float4::load(lanes[2]);
+        block.edge1_x = Float4::load(lanes[3]); block.edge1_y = Float4::load(lanes[4]); block.edge1_z = Float4::load(lanes[5]);
+        block.edge2_x = Float4::load(lanes[6]); block.edge2_y = Float4::load(lanes[7]); block.edge2_z = Float4::load(lanes[8]);
+        for (int i = 0; i < 4; ++i) {
+            block.triangle[i] = lane_tris[i];
+            lane_tris[i] = NO_HIT;
+            for (int k = 0; k < 9; ++k) lanes[k][i] = 0.0f;
+        }
+        blocks.push_back(block);
+        lane = 0;
+    }
+
+    std::vector<TriangleBlock4>& blocks;
+    float lanes[9][4] = {};
+    uint32_t lane_tris[4] = { NO_HIT, NO_HIT, NO_HIT, NO_HIT };
+    int lane = 0;
+};
+
+} // namespace
+
+Raytracer::Raytracer(int threads)
     : rendering(false)
     , current_sample(0)
-    {}
+    , thread_active(false)
+    , cancel_requested(false)
+    , preview_denoise(false)
+{
+    if (threads > 0) {
+        num_threads = threads;
+    }
+    thread_pool = std::make_unique<ThreadPool>(num_threads);
+    worker_stats.resize(thread_pool->size());
+}
 
 Raytracer::~Raytracer() {
     stop_render();
 }
 
 void Raytracer::start_render(const RenderScene& new_scene, const Camera& new_camera, const RenderConfig& new_config) {
+    stop_render();
+
+    scene = new_scene;
+    source_scene = nullptr; // not ours to update()
+
+    RenderSceneChanges changes;
+    changes.rebuilt = true;
+    begin_render(changes, new_camera, new_config);
+}
+
+void Raytracer::start_render(const Scene* new_scene, const Camera& new_camera, const RenderConfig& new_config) {
+    stop_render();
+
+    RenderSceneChanges changes;
+    if (new_scene && new_scene == source_scene) {
+        changes = scene.update(new_scene);
+    }
+    else {
+        scene = RenderScene::from_scene(new_scene);
+        source_scene = new_scene;
+        changes.rebuilt = true;
+    }
+    begin_render(changes, new_camera, new_config);
+}
+
+void Raytracer::begin_render(const RenderSceneChanges& changes, const Camera& new_camera, const RenderConfig& new_config) {
+    // the CPU bvhs don't care about materials, the GAS's prims carry theirs.
+    // moves can be refit, but only onto bvhs that were current before them
+    const bool can_refit = cpu_accel_current && !changes.rebuilt;
+    if (changes.rebuilt || changes.geometry) {
+        cpu_accel_current = false;
+    }
+    if (changes.any()) {
+        gpu_scene_current = false;
+    }
+
     // store the desired backend from config
     RenderBackend requested_backend = new_config.backend;
 
@@ -35,10 +153,10 @@ void Raytracer::start_render(const RenderScene& new_scene, const Camera& new_cam
             }
         }
         
-        if (optix_backend && requested_backend == RenderBackend::OptiX) {
-            // TEMP - this rebuilds the GAS each time we render, even if scene's unchanged
-            // TODO: cache scene hash to check this
-            optix_backend->build_scene(new_scene);
+        // the GAS is rebuilt whole, but only when the scene's changed since the last one
+        if (optix_backend && requested_backend == RenderBackend::OptiX && !gpu_scene_current) {
+            optix_backend->build_scene(scene);
+            gpu_scene_current = true;
         }
     }
 #else
@@ -50,26 +168,140 @@ void Raytracer::start_render(const RenderScene& new_scene, const Camera& new_cam
 #endif
 
     active_backend = requested_backend;
-    scene = new_scene;
     camera = new_camera;
     config = new_config;
 
-    pixels.resize(config.width * config.height * 3, 0.0f);
-    sample_buffer.resize(config.width * config.height * 3, 0.0f);
+    // an unchanged scene keeps its bvhs, eg when only the camera or settings moved
+    if (active_backend != RenderBackend::OptiX) {
+        if (!cpu_accel_current) {
+            if (!can_refit || !refit_acceleration(changes)) {
+                build_acceleration();
+            }
+            cpu_accel_current = true;
+        }
+        build_lights();
+    }
+    else {
+        lights.clear();
+    }
+
+    pixels.assign(config.width * config.height * 3, 0.0f);
+    sample_buffer.assign(config.width * config.height * 3, 0.0f);
+    for (int i = 0; i < AOV_COUNT; ++i) {
+        const Aov aov = Aov(i);
+        const size_t size = has_aov(aov) ? size_t(config.width) * config.height * aov_channels(aov) : 0;
+        aov_samples[i].assign(size, 0.0f);
+        aov_buffers[i].assign(size, 0.0f);
+        // clear out whatever a previous render with it enabled left behind
+        aov_samples[i].shrink_to_fit();
+        aov_buffers[i].shrink_to_fit();
+    }
+    luminance_mean.assign(config.width * config.height, 0.0f);
+    luminance_m2.assign(config.width * config.height, 0.0f);
+    denoised_pixels.clear();
+    build_tiles();
+
+    std::fill(worker_stats.begin(), worker_stats.end(), RenderStats());
+    sample_stats = RenderStats();
+    total_stats = RenderStats();
 
     rendering = true;
     current_sample = 0;
+    render_id++;
+}
+
+void Raytracer::render_async()
+{
+    if (!rendering || render_thread.joinable()) return;
+
+    // the first frame is only ever read for its size, the thread refills it after a pass
+    publish_frame(false);
+    thread_active = true;
+    render_thread = std::thread(&Raytracer::render_loop, this);
 }
 
 void Raytracer::stop_render()
 {
+    cancel_requested = true;
+    if (render_thread.joinable()) {
+        render_thread.join();
+    }
+    cancel_requested = false;
     rendering = false;
 }
 
+void Raytracer::render_loop()
+{
+    while (rendering && !cancel_requested) {
+        render_one_sample();
+        // the last pass always gets filtered, so the finished frame isn't a stale denoise
+        publish_frame(!rendering);
+    }
+    thread_active = false;
+}
+
+void Raytracer::publish_frame(bool force_denoise)
+{
+    RenderFrame& frame = frames.write_buffer();
+    frame.width = config.width;
+    frame.height = config.height;
+    frame.pixels = pixels;
+    frame.samples = current_sample;
+    frame.progress = get_progress();
+    frame.stats = total_stats;
+    frame.render_id = render_id;
+    if (active_backend == RenderBackend::OptiX) {
+        frame.tiles.clear();
+    }
+    else {
+        frame.tiles = tiles;
+    }
+
+    if (preview_denoise) {
+        auto now = std::chrono::steady_clock::now();
+        if (force_denoise || denoised_pixels.empty() || now - last_denoise >= DENOISE_INTERVAL) {
+            denoise();
+            last_denoise = now;
+            denoise_revision++;
+        }
+        frame.denoise_revision = denoise_revision;
+        // empty when denoise() had no aovs to work with and passed pixels through
+        frame.denoised = denoised_pixels.empty() ? pixels : denoised_pixels;
+    }
+    else {
+        frame.denoised.clear();
+    }
+
+    frames.publish();
+}
+
+void Raytracer::set_preview_denoise(bool enabled)
+{
+    preview_denoise = enabled;
+    if (!is_rendering() && !pixels.empty()) {
+        // the thread may still be on its way out from publishing the last frame
+        if (render_thread.joinable()) {
+            render_thread.join();
+        }
+        publish_frame(true);
+    }
+}
+
 float Raytracer::get_progress() const
 {
     if (config.samples_per_pixel == 0) return 1.0f;
-    return float(current_sample) / float(config.samples_per_pixel);
+    if (active_backend == RenderBackend::OptiX || tiles.empty()) {
+        return float(current_sample) / float(config.samples_per_pixel);
+    }
+
+    int64_t total = 0;
+    int64_t done = 0;
+    for (const Tile& tile : tiles) {
+        int64_t tile_pixels = int64_t(tile.end_x - tile.start_x) * (tile.end_y - tile.start_y);
+        total += tile_pixels * config.samples_per_pixel;
+        done += tile_pixels * (tile.converged ? config.samples_per_pixel : std::min(tile.samples, config.samples_per_pixel));
+    }
+    return total > 0 ? float(double(done) / double(total)) : 1.0f;
 }
 
 void Raytracer::render_one_sample() {
@@ -83,7 +315,7 @@ void Raytracer::render_one_sample() {
         optix_backend->render_sample(
             camera,
             config.width, config.height,
-            current_sample,
+            config.first_sample + current_sample,
             config.max_bounces,
             config.seed
         );
@@ -101,11 +333,16 @@ void Raytracer::render_one_sample() {
             std::fill(sample_buffer.begin(), sample_buffer.end(), 0.0f);
         }
 
-        // accumulate, same as CPU
-        float weight = 1.0f / float(current_sample + 1);
-        for (size_t i = 0; i < pixels.size() && i < sample_buffer.size(); i++) {
-            pixels[i] = pixels[i] * (1.0f - weight) + sample_buffer[i] * weight;
-        }
+        // accumulate, same as CPU but the whole image at once, a row per task
+        const float weight = 1.0f / float(current_sample + 1);
+        const int row_floats = config.width * 3;
+        thread_pool->parallel_for(config.height, [this, weight, row_floats](int y) {
+            float* row = &pixels[size_t(y) * row_floats];
+            const float* samples = &sample_buffer[size_t(y) * row_floats];
+            for (int i = 0; i < row_floats; ++i) {
+                row[i] = row[i] * (1.0f - weight) + samples[i] * weight;
+            }
+        });
 
         current_sample++;
 
@@ -116,54 +353,133 @@ void Raytracer::render_one_sample() {
     }
 #endif
 
-    std::fill(sample_buffer.begin(), sample_buffer.end(), 0.0f);
-
+    auto pass_start = std::chrono::steady_clock::now();
     CameraBasis basis = compute_camera_basis();
 
-    // split image into horizontal tiles
-    const int tile_size = 64; //TODO profile
-    int tiles_x = (config.width + tile_size - 1) / tile_size;
-    int tiles_y = (config.height + tile_size - 1) / tile_size;
+    const bool wavefront = active_backend == RenderBackend::CPUWavefront;
 
-    std::vector<std::thread> threads;
+    // converged tiles have dropped out of active_tiles, so they cost nothing from here on
+    thread_pool->parallel_for(int(active_tiles.size()), [this, &basis, wavefront](int i) {
+        // whatever's left is skipped, tiles already done keep their extra sample
+        if (cancel_requested) return;
 
-    for (int ty = 0; ty < tiles_y; ++ty) {
-        for (int tx = 0; tx < tiles_x; ++tx) {
-            int start_x = tx * tile_size;
-            int end_x = std::min(start_x + tile_size, config.width);
-            int start_y = ty * tile_size;
-            int end_y = std::min(start_y + tile_size, config.height);
+        Tile& tile = tiles[active_tiles[i]];
 
-            threads.emplace_back([this, start_x, end_x, start_y, end_y, basis]() {
-                render_tile(start_x, end_x, start_y, end_y, basis);
-                });
+        for (int y = tile.start_y; y < tile.end_y; ++y) {
+            float* row = &sample_buffer[(y * config.width + tile.start_x) * 3];
+            std::fill(row, row + (tile.end_x - tile.start_x) * 3, 0.0f);
         }
-    }
 
-    for (auto& t : threads) {
-        t.join();
-    }
+        if (wavefront) {
+            render_tile_wavefront(tile.start_x, tile.end_x, tile.start_y, tile.end_y, basis);
+        }
+        else {
+            render_tile(tile.start_x, tile.end_x, tile.start_y, tile.end_y, basis);
+        }
 
-    // accumulate
-    float weight = 1.0f / float(current_sample + 1);
-    for (size_t i = 0; i < pixels.size(); i++) {
-        pixels[i] = pixels[i] * (1.0f - weight) + sample_buffer[i] * weight;
-    }
+        accumulate_tile(tile);
+    });
+
+    active_tiles.erase(
+        std::remove_if(active_tiles.begin(), active_tiles.end(), [this](int t) { return tiles[t].converged; }),
+        active_tiles.end()
+    );
+
+    // a cancelled pass still did the work, so it counts towards the totals
+    merge_thread_stats(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pass_start).count());
+
+    if (cancel_requested) return;
     current_sample++;
 
-    if (current_sample >= config.samples_per_pixel) {
+    if (current_sample >= config.samples_per_pixel || active_tiles.empty()) {
         rendering = false;
     }
 }
 
+void Raytracer::merge_thread_stats(double wall_ms) {
+    sample_stats = RenderStats();
+    for (RenderStats& stats : worker_stats) {
+        sample_stats.merge(stats);
+        stats = RenderStats();
+    }
+    sample_stats.wall_ms = wall_ms;
+    total_stats.merge(sample_stats);
+}
+
+void Raytracer::accumulate_tile(Tile& tile) {
+    // below this a pixel's error is judged against the floor instead, so near-black
+    // pixels don't hold a tile open over noise nobody can see
+    const float min_luminance = 0.05f;
+
+    const int n = tile.samples + 1;
+    const float weight = 1.0f / float(n);
+    float error_sum = 0.0f;
+
+    for (int y = tile.start_y; y < tile.end_y; ++y) {
+        // the row's rgb is contiguous, so it's blended in one loop the compiler vectorises
+        const size_t row_start = (size_t(y) * config.width + tile.start_x) * 3;
+        const int row_floats = (tile.end_x - tile.start_x) * 3;
+        float* row = &pixels[row_start];
+        const float* samples = &sample_buffer[row_start];
+        for (int i = 0; i < row_floats; ++i) {
+            row[i] = row[i] * (1.0f - weight) + samples[i] * weight;
+        }
+
+        for (int x = tile.start_x; x < tile.end_x; ++x) {
+            int pixel = y * config.width + x;
+            int index = pixel * 3;
+
+            for (int i = 0; i < AOV_COUNT; ++i) {
+                if (aov_buffers[i].empty()) continue;
+
+                const Aov aov = Aov(i);
+                const int channels = aov_channels(aov);
+                const bool is_id = aov == Aov::MaterialId || aov == Aov::PrimitiveId;
+                for (int c = 0; c < channels; ++c) {
+                    int aov_index = pixel * channels + c;
+                    aov_buffers[i][aov_index] = is_id
+                        ? (n == 1 ? aov_samples[i][aov_index] : aov_buffers[i][aov_index])
+                        : aov_buffers[i][aov_index] * (1.0f - weight) + aov_samples[i][aov_index] * weight;
+                }
+            }
+
+            // welford update on this sample's luminance
+            float lum = luminance(sample_buffer[index + 0], sample_buffer[index + 1], sample_buffer[index + 2]);
+            float delta = lum - luminance_mean[pixel];
+            luminance_mean[pixel] += delta / float(n);
+            luminance_m2[pixel] += delta * (lum - luminance_mean[pixel]);
+
+            if (n > 1) {
+                float variance = luminance_m2[pixel] / float(n - 1);
+                float std_error = std::sqrt(variance / float(n));
+                error_sum += std_error / std::max(luminance_mean[pixel], min_luminance);
+            }
+        }
+    }
+
+    // averaged over the tile rather than the worst pixel: a single firefly shouldn't keep
+    // a whole tile going, and a pixel that's been lucky so far is covered by its neighbours
+    const int tile_pixels = (tile.end_x - tile.start_x) * (tile.end_y - tile.start_y);
+
+    tile.samples = n;
+    tile.error = error_sum / float(tile_pixels);
+    tile.converged = config.noise_threshold > 0.0f
+        && tile.samples >= std::max(config.min_samples, 2)
+        && tile.error < config.noise_threshold;
+}
+
 void Raytracer::render_tile(int start_x, int end_x, int start_y, int end_y, const CameraBasis& basis) {
+    if (config.packet_primary_rays) {
+        render_tile_packets(start_x, end_x, start_y, end_y, basis);
+        return;
+    }
+
     for (int y = start_y; y < end_y; ++y) {
         for (int x = start_x; x < end_x; ++x) {
-            // seed rng deterministically per pixel
-            uint64_t pixel_rng = hash_pixel(x, y, config.seed + current_sample);
+            Sampler sampler = make_sampler(x, y);
 
-            float px = float(x) + random_float(pixel_rng);
-            float py = float(y) + random_float(pixel_rng);
+            float px = float(x) + sampler.get(CameraDimension::PixelX);
+            float py = float(y) + sampler.get(CameraDimension::PixelY);
 
             // convert u,v to pixel position with jitter
             Vec3 pixel_centre = basis.viewport_upper_left
@@ -173,14 +489,110 @@ void Raytracer::render_tile(int start_x, int end_x, int start_y, int end_y, cons
             Vec3 ray_dir = (pixel_centre - basis.camera_pos).normalised();
             Ray ray(basis.camera_pos, ray_dir);
 
-            Colour pixel_colour = ray_colour(ray, config.max_bounces, pixel_rng);
+            PathState path(ray, config.max_bounces, sampler);
+            trace_path(path);
+            write_sample(y * config.width + x, path);
+        }
+    }
+}
+
+void Raytracer::write_sample(int pixel, const PathState& path) {
+    sample_buffer[pixel * 3 + 0] += path.radiance.r;
+    sample_buffer[pixel * 3 + 1] += path.radiance.g;
+    sample_buffer[pixel * 3 + 2] += path.radiance.b;
+    thread_stats().add_path(path.bounces);
+
+    if (config.aovs == 0) return;
 
-            int pixel_index = (y * config.width + x) * 3;
-            sample_buffer[pixel_index + 0] += pixel_colour.r;
-            sample_buffer[pixel_index + 1] += pixel_colour.g;
-            sample_buffer[pixel_index + 2] += pixel_colour.b;
+    if (has_aov(Aov::Depth)) {
+        aov_samples[int(Aov::Depth)][pixel] = path.first_depth;
+    }
+    if (has_aov(Aov::Normal)) {
+        float* normal = &aov_samples[int(Aov::Normal)][pixel * 3];
+        normal[0] = path.first_normal.x;
+        normal[1] = path.first_normal.y;
+        normal[2] = path.first_normal.z;
+    }
+    if (has_aov(Aov::Albedo)) {
+        float* albedo = &aov_samples[int(Aov::Albedo)][pixel * 3];
+        albedo[0] = path.first_albedo.r;
+        albedo[1] = path.first_albedo.g;
+        albedo[2] = path.first_albedo.b;
+    }
+    if (has_aov(Aov::MaterialId)) {
+        aov_samples[int(Aov::MaterialId)][pixel] = float(path.first_material_id);
+    }
+    if (has_aov(Aov::PrimitiveId)) {
+        aov_samples[int(Aov::PrimitiveId)][pixel] = float(path.first_prim_id);
+    }
+    if (has_aov(Aov::BounceCount)) {
+        aov_samples[int(Aov::BounceCount)][pixel] = float(path.bounces);
+    }
+}
+
+const std::vector<float>& Raytracer::denoise() {
+    if ((config.aovs & DENOISER_AOVS) != DENOISER_AOVS) return pixels;
+
+    // variance of each pixel's mean, from the adaptive sampling stats.  tiles sample
+    // in lockstep so every pixel in one shares a sample count
+    pixel_variance.resize(luminance_m2.size());
+    for (const Tile& tile : tiles) {
+        const int n = tile.samples;
+        for (int y = tile.start_y; y < tile.end_y; ++y) {
+            for (int x = tile.start_x; x < tile.end_x; ++x) {
+                int pixel = y * config.width + x;
+                // a single sample says nothing about noise, so let it be smoothed freely
+                pixel_variance[pixel] = n > 1
+                    ? luminance_m2[pixel] / float(n - 1) / float(n)
+                    : 1e10f;
+            }
         }
     }
+
+    denoiser.denoise(config.width, config.height,
+        DenoiseChannels{ pixels.data(), 3 },
+        DenoiseChannels{ get_aov(Aov::Albedo).data(), 3 },
+        DenoiseChannels{ get_aov(Aov::Normal).data(), 3 },
+        DenoiseChannels{ get_aov(Aov::Depth).data(), 1 },
+        DenoiseChannels{ pixel_variance.data(), 1 },
+        *thread_pool, denoised_pixels);
+    return denoised_pixels;
+}
+
+void Raytracer::build_tiles() {
+    // split image into square tiles, handed out to the thread pool each sample
+    const int tile_size = 64; //TODO profile
+    int tiles_x = (config.width + tile_size - 1) / tile_size;
+    int tiles_y = (config.height + tile_size - 1) / tile_size;
+
+    tiles.clear();
+    tiles.reserve(tiles_x * tiles_y);
+
+    for (int ty = 0; ty < tiles_y; ++ty) {
+        for (int tx = 0; tx < tiles_x; ++tx) {
+            Tile tile;
+            tile.start_x = tx * tile_size;
+            tile.end_x = std::min(tile.start_x + tile_size, config.width);
+            tile.start_y = ty * tile_size;
+            tile.end_y = std::min(tile.start_y + tile_size, config.height);
+            tile.samples = 0;
+            tile.error = 0.0f;
+            tile.converged = false;
+            tiles.push_back(tile);
+        }
+    }
+
+    active_tiles.resize(tiles.size());
+    std::iota(active_tiles.begin(), active_tiles.end(), 0);
+}
+
+Sampler Raytracer::make_sampler(int x, int y) const {
+    // sobol wants the same scramble every pass and the pass as its index, random
+    // a fresh stream every pass
+    const int pass = config.first_sample + current_sample;
+    uint32_t pixel_seed = uint32_t(hash_pixel(x, y, config.seed));
+    uint64_t pixel_rng = hash_pixel(x, y, config.seed + pass);
+    return Sampler(config.sampler, pixel_seed, uint32_t(pass), pixel_rng);
 }
 
 uint64_t Raytracer::hash_pixel(int x, int y, uint64_t seed) const {
@@ -219,37 +631,360 @@ CameraBasis Raytracer::compute_camera_basis() const {
 }
 
 // == render methods ==
+void Raytracer::build_acceleration()
+{
+    // bottom level first, the top level needs each instanced mesh's bounds.  the
+    // meshes are independent so they build in parallel
+    mesh_accels.clear();
+    mesh_accels.resize(scene.meshes.size());
+
+    std::vector<uint32_t> instanced_meshes;
+    for (const RenderInstance& instance : scene.instances) {
+        instanced_meshes.push_back(instance.mesh_id);
+    }
+    std::sort(instanced_meshes.begin(), instanced_meshes.end());
+    instanced_meshes.erase(std::unique(instanced_meshes.begin(), instanced_meshes.end()), instanced_meshes.end());
+
+    thread_pool->parallel_for(int(instanced_meshes.size()), [this, &instanced_meshes](int i) {
+        build_mesh_accel(instanced_meshes[i]);
+    });
+
+    // top level bvh indices [0, primitives.size()) are analytic prims, then world
+    // space mesh tris, then instances
+    const uint32_t num_prims = uint32_t(scene.primitives.size());
+    const uint32_t first_instance = num_prims + uint32_t(scene.triangles.size());
+
+    item_bounds.clear();
+    item_bounds.reserve(first_instance + scene.instances.size());
+    for (const auto& prim : scene.primitives) {
+        item_bounds.push_back(prim.bounds());
+    }
+    for (const auto& tri : scene.triangles) {
+        item_bounds.push_back(scene.triangle_bounds(tri));
+    }
+    for (const auto& instance : scene.instances) {
+        item_bounds.push_back(transform_bounds(mesh_accels[instance.mesh_id].bounds, instance.object_to_world));
+    }
+    bvh.build(item_bounds);
+    bvh4.build(bvh);
+    built_sah_cost = bvh.sah_cost();
+
+    // each world space mesh's tris are together in scene.triangles
+    mesh_first_triangle.assign(scene.meshes.size(), NO_HIT);
+    for (uint32_t i = uint32_t(scene.triangles.size()); i-- > 0;) {
+        mesh_first_triangle[scene.triangles[i].mesh_id] = i;
+    }
+
+    // repack each wide leaf's tris into SIMD blocks, everything else stays as an index
+    const std::vector<uint32_t>& leaf_indices = bvh4.get_prim_indices();
+
+    leaf_geometry.clear();
+    triangle_blocks.clear();
+    leaf_prims.clear();
+    leaf_instances.clear();
+    leaf_geometry.reserve(bvh4.get_leaves().size());
+
+    for (const Bvh4Leaf& leaf : bvh4.get_leaves()) {
+        LeafGeometry geo;
+        geo.first_block = uint32_t(triangle_blocks.size());
+        geo.first_prim = uint32_t(leaf_prims.size());
+        geo.first_instance = uint32_t(leaf_instances.size());
+
+        for (uint32_t i = 0; i < leaf.count; ++i) {
+            uint32_t item = leaf_indices[leaf.first + i];
+            if (item < num_prims) {
+                leaf_prims.push_back(item);
+            }
+            else if (item >= first_instance) {
+                leaf_instances.push_back(item - first_instance);
+            }
+        }
+        pack_leaf_triangles(leaf, triangle_blocks);
+
+        geo.block_count = uint32_t(triangle_blocks.size()) - geo.first_block;
+        geo.prim_count = uint32_t(leaf_prims.size()) - geo.first_prim;
+        geo.instance_count = uint32_t(leaf_instances.size()) - geo.first_instance;
+        leaf_geometry.push_back(geo);
+    }
+}
+
+void Raytracer::pack_leaf_triangles(const Bvh4Leaf& leaf, std::vector<TriangleBlock4>& blocks) const
+{
+    const uint32_t num_prims = uint32_t(scene.primitives.size());
+    const uint32_t first_instance = num_prims + uint32_t(scene.triangles.size());
+    const std::vector<uint32_t>& leaf_indices = bvh4.get_prim_indices();
+
+    TriangleBlockPacker packer(blocks);
+    for (uint32_t i = 0; i < leaf.count; ++i) {
+        const uint32_t item = leaf_indices[leaf.first + i];
+        if (item < num_prims || item >= first_instance) continue;
+
+        const RenderTriangle& tri = scene.triangles[item - num_prims];
+        packer.add(scene.meshes[tri.mesh_id], tri.tri_index, item - num_prims);
+    }
+    packer.finish();
+}
+
+bool Raytracer::refit_acceleration(const RenderSceneChanges& changes)
+{
+    const uint32_t num_prims = uint32_t(scene.primitives.size());
+    const uint32_t first_instance = num_prims + uint32_t(scene.triangles.size());
+
+    std::vector<uint32_t> changed_items;
+    std::vector<uint8_t> moved_tris(scene.triangles.size(), 0);
+
+    for (uint32_t prim : changes.moved_primitives) {
+        item_bounds[prim] = scene.primitives[prim].bounds();
+        changed_items.push_back(prim);
+    }
+
+    std::vector<uint32_t> reshaped; // object space meshes, ie instanced
+    for (uint32_t mesh_id : changes.moved_meshes) {
+        const uint32_t first = mesh_first_triangle[mesh_id];
+        if (first == NO_HIT) {
+            reshaped.push_back(mesh_id);
+            continue;
+        }
+        const uint32_t count = uint32_t(scene.meshes[mesh_id].tri_count());
+        for (uint32_t i = first; i < first + count; ++i) {
+            item_bounds[num_prims + i] = scene.triangle_bounds(scene.triangles[i]);
+            changed_items.push_back(num_prims + i);
+            moved_tris[i] = 1;
+        }
+    }
+
+    // a reshaped mesh gets a new bvh of its own, and moves every placement of it
+    std::sort(reshaped.begin(), reshaped.end());
+    reshaped.erase(std::unique(reshaped.begin(), reshaped.end()), reshaped.end());
+    for (uint32_t mesh_id : reshaped) {
+        mesh_accels[mesh_id] = MeshAccel();
+        build_mesh_accel(mesh_id);
+    }
+
+    std::vector<uint8_t> moved_instances(scene.instances.size(), 0);
+    for (uint32_t instance_index : changes.moved_instances) {
+        moved_instances[instance_index] = 1;
+    }
+    for (uint32_t i = 0; i < uint32_t(scene.instances.size()); ++i) {
+        const RenderInstance& instance = scene.instances[i];
+        if (!moved_instances[i] && !std::binary_search(reshaped.begin(), reshaped.end(), instance.mesh_id)) continue;
+
+        item_bounds[first_instance + i] = transform_bounds(mesh_accels[instance.mesh_id].bounds, instance.object_to_world);
+        changed_items.push_back(first_instance + i);
+    }
+
+    bvh.refit(item_bounds, changed_items);
+    if (bvh.sah_cost() > built_sah_cost * REFIT_SAH_LIMIT) {
+        return false; // moved too far from what the tree was built around
+    }
+    bvh4.refit(bvh);
+
+    // the blocks hold copies of the vertices, so leaves with moved tris repack.
+    // same tris in the same leaves, so the same number of blocks
+    const std::vector<uint32_t>& leaf_indices = bvh4.get_prim_indices();
+    const std::vector<Bvh4Leaf>& leaves = bvh4.get_leaves();
+    std::vector<TriangleBlock4> repacked;
+    for (size_t leaf_index = 0; leaf_index < leaves.size(); ++leaf_index) {
+        const Bvh4Leaf& leaf = leaves[leaf_index];
+
+        bool moved = false;
+        for (uint32_t i = 0; i < leaf.count && !moved; ++i) {
+            const uint32_t item = leaf_indices[leaf.first + i];
+            moved = item >= num_prims && item < first_instance && moved_tris[item - num_prims];
+        }
+        if (!moved) continue;
+
+        repacked.clear();
+        pack_leaf_triangles(leaf, repacked);
+        std::copy(repacked.begin(), repacked.end(), triangle_blocks.begin() + leaf_geometry[leaf_index].first_block);
+    }
+
+    return true;
+}
+
+void Raytracer::build_mesh_accel(uint32_t mesh_id)
+{
+    const RenderMesh& mesh = scene.meshes[mesh_id];
+    MeshAccel& accel = mesh_accels[mesh_id];
+
+    std::vector<Aabb> tri_bounds;
+    tri_bounds.reserve(mesh.tri_count());
+    for (uint32_t i = 0; i < uint32_t(mesh.tri_count()); ++i) {
+        tri_bounds.push_back(scene.triangle_bounds(RenderTriangle{ mesh_id, i }));
+    }
+
+    // the binary tree is only needed to collapse from, instances never see packets
+    Bvh binary;
+    binary.build(tri_bounds);
+    accel.bounds = binary.empty() ? Aabb() : binary.get_nodes()[0].bounds;
+    accel.bvh4.build(binary);
+
+    const std::vector<uint32_t>& leaf_indices = accel.bvh4.get_prim_indices();
+    for (const Bvh4Leaf& leaf : accel.bvh4.get_leaves()) {
+        LeafGeometry geo = {};
+        geo.first_block = uint32_t(accel.triangle_blocks.size());
+
+        TriangleBlockPacker packer(accel.triangle_blocks);
+        for (uint32_t i = 0; i < leaf.count; ++i) {
+            const uint32_t tri_index = leaf_indices[leaf.first + i];
+            packer.add(mesh, tri_index, tri_index);
+        }
+        packer.finish();
+
+        geo.block_count = uint32_t(accel.triangle_blocks.size()) - geo.first_block;
+        accel.leaf_geometry.push_back(geo);
+    }
+}
+
+void Raytracer::build_lights()
+{
+    lights.clear();
+    if (!config.light_sampling) return;
+
+    for (uint32_t i = 0; i < uint32_t(scene.primitives.size()); ++i) {
+        if (is_light(i)) {
+            lights.push_back(i);
+        }
+    }
+}
+
 bool Raytracer::intersect(const Ray& ray, float t_min, float t_max, Intersection& rec) const
 {
     Intersection temp_rec;
+    float closest_so_far = t_max;
+
+    RenderStats& stats = thread_stats();
+    stats.rays++;
+    const std::vector<Bvh4Leaf>& leaves = bvh4.get_leaves();
+
+    return bvh4.traverse(ray, t_min, closest_so_far, [&](uint32_t leaf_index, float& t_closest) {
+        stats.primitive_tests += leaves[leaf_index].count;
+        if (!intersect_leaf(leaf_geometry[leaf_index], ray, t_min, t_closest, temp_rec)) {
+            return false;
+        }
+        t_closest = temp_rec.t;
+        rec = temp_rec;
+        return true;
+    }, stats.node_visits);
+}
+
+bool Raytracer::intersect_leaf(const LeafGeometry& leaf, const Ray& ray, float t_min, float t_max, Intersection& rec) const
+{
     bool hit_anything = false;
     float closest_so_far = t_max;
 
-    for (const auto& prim : scene.primitives) {
-        bool hit = false;
+    for (uint32_t i = 0; i < leaf.prim_count; ++i) {
+        uint32_t prim_index = leaf_prims[leaf.first_prim + i];
+        if (intersect_primitive(scene.primitives[prim_index], ray, t_min, closest_so_far, rec)) {
+            rec.prim_id = prim_index;
+            closest_so_far = rec.t;
+            hit_anything = true;
+        }
+    }
 
-        switch (prim.type) {
-        case RenderPrimitive::Type::Sphere:
-            hit = intersect_sphere(prim, ray, t_min, closest_so_far, temp_rec);
-            break;
-        case RenderPrimitive::Type::Quad:
-            hit = intersect_quad(prim, ray, t_min, closest_so_far, temp_rec);
-            break;
-        case RenderPrimitive::Type::Triangle:
-            hit = intersect_triangle(prim, ray, t_min, closest_so_far, temp_rec);
-            break;
+    for (uint32_t i = 0; i < leaf.block_count; ++i) {
+        if (intersect_triangle_block(triangle_blocks[leaf.first_block + i], NO_HIT, ray, t_min, closest_so_far, rec)) {
+            closest_so_far = rec.t;
+            hit_anything = true;
         }
+    }
 
-        if (hit) {
+    for (uint32_t i = 0; i < leaf.instance_count; ++i) {
+        const uint32_t instance_index = leaf_instances[leaf.first_instance + i];
+        if (intersect_instance(instance_index, ray, t_min, closest_so_far, rec)) {
+            closest_so_far = rec.t;
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
         }
     }
 
     return hit_anything;
 }
 
+bool Raytracer::intersect_instance(uint32_t instance_index, const Ray& ray, float t_min, float t_max, Intersection& rec) const
+{
+    const RenderInstance& instance = scene.instances[instance_index];
+    const MeshAccel& accel = mesh_accels[instance.mesh_id];
+
+    // direction isn't renormalised, so t is the same distance along the ray in both spaces
+    const Ray local_ray(
+        instance.world_to_object.transform_point(ray.origin),
+        instance.world_to_object.transform_direction(ray.direction));
+
+    RenderStats& stats = thread_stats();
+    const std::vector<Bvh4Leaf>& leaves = accel.bvh4.get_leaves();
+    Intersection local_rec;
+    float closest_so_far = t_max;
+
+    bool hit = accel.bvh4.traverse(local_ray, t_min, closest_so_far, [&](uint32_t leaf_index, float& t_closest) {
+        stats.primitive_tests += leaves[leaf_index].count;
+        const LeafGeometry& leaf = accel.leaf_geometry[leaf_index];
+
+        bool hit_leaf = false;
+        for (uint32_t i = 0; i < leaf.block_count; ++i) {
+            if (intersect_triangle_block(accel.triangle_blocks[leaf.first_block + i], instance.mesh_id, local_ray, t_min, t_closest, local_rec)) {
+                t_closest = local_rec.t;
+                hit_leaf = true;
+            }
+        }
+        return hit_leaf;
+    }, stats.node_visits);
+
+    if (!hit) return false;
+
+    // back to world space, the normal transformed the same way create_mesh bakes them
+    const Vec3 outward = local_rec.front_face ? local_rec.normal : local_rec.normal * -1.0f;
+    rec.t = local_rec.t;
+    rec.point = ray.at(rec.t);
+    rec.set_face_normal(ray, instance.object_to_world.transform_direction(outward).normalised());
+    rec.material_id = instance.material_id;
+    rec.prim_id = uint32_t(scene.primitives.size() + scene.triangles.size()) + instance_index;
+    return true;
+}
+
+bool Raytracer::occluded(const Ray& ray, float t_min, float t_max) const
+{
+    RenderStats& stats = thread_stats();
+    stats.rays++;
+    const std::vector<Bvh4Leaf>& leaves = bvh4.get_leaves();
+
+    return bvh4.occluded(ray, t_min, t_max, [&](uint32_t leaf_index, float t_closest) {
+        stats.primitive_tests += leaves[leaf_index].count;
+        Intersection rec;
+        return intersect_leaf(leaf_geometry[leaf_index], ray, t_min, t_closest, rec);
+    }, stats.node_visits);
+}
+
+bool Raytracer::intersect_item(uint32_t item, const Ray& ray, float t_min, float t_max, Intersection& rec) const
+{
+    thread_stats().primitive_tests++;
+
+    const uint32_t num_prims = uint32_t(scene.primitives.size());
+    const uint32_t first_instance = num_prims + uint32_t(scene.triangles.size());
+    if (item >= first_instance) {
+        return intersect_instance(item - first_instance, ray, t_min, t_max, rec);
+    }
+
+    bool hit = item < num_prims
+        ? intersect_primitive(scene.primitives[item], ray, t_min, t_max, rec)
+        : intersect_triangle(scene.triangles[item - num_prims], ray, t_min, t_max, rec);
+    if (hit) {
+        rec.prim_id = item;
+    }
+    return hit;
+}
+
+bool Raytracer::intersect_primitive(const RenderPrimitive& prim, const Ray& ray, float t_min, float t_max, Intersection& rec) const
+{
+    switch (prim.type) {
+    case RenderPrimitive::Type::Sphere:
+        return intersect_sphere(prim, ray, t_min, t_max, rec);
+    case RenderPrimitive::Type::Quad:
+        return intersect_quad(prim, ray, t_min, t_max, rec);
+    default:
+        return false;
+    }
+}
+
 // == intersect prims ==
 
 bool Raytracer::intersect_sphere(const RenderPrimitive& prim, const Ray& ray, float t_min, float t_max, Intersection& rec ) const
@@ -276,7 +1011,7 @@ bool Raytracer::intersect_sphere(const RenderPrimitive& prim, const Ray& ray, fl
     rec.point = ray.at(rec.t);
     Vec3 outward_normal = (rec.point - prim.centre) / prim.radius;
     rec.set_face_normal(ray, outward_normal);
-    rec.material = prim.material;
+    rec.material_id = prim.material_id;
 
     return true;
 }
@@ -304,17 +1039,23 @@ bool Raytracer::intersect_quad( const RenderPrimitive& prim, const Ray& ray, flo
     rec.t = t;
     rec.point = hit_point;
     rec.set_face_normal(ray, prim.quad_normal);
-    rec.material = prim.material;
+    rec.material_id = prim.material_id;
 
     return true;
 }
 
-bool Raytracer::intersect_triangle( const RenderPrimitive& prim, const Ray& ray, float t_min, float t_max, Intersection& rec ) const
+bool Raytracer::intersect_triangle( const RenderTriangle& tri, const Ray& ray, float t_min, float t_max, Intersection& rec ) const
 {
+    const RenderMesh& mesh = scene.meshes[tri.mesh_id];
+    const uint32_t* idx = &mesh.indices[tri.tri_index * 3];
+    const Vec3& v0 = mesh.positions[idx[0]];
+    const Vec3& v1 = mesh.positions[idx[1]];
+    const Vec3& v2 = mesh.positions[idx[2]];
+
     //TEMP copied over from geometry.cpp TODO:unify
     // Moeller-Trumbore intersection algorithm
-    Vec3 edge1 = prim.tri_v1 - prim.tri_v0;
-    Vec3 edge2 = prim.tri_v2 - prim.tri_v0;
+    Vec3 edge1 = v1 - v0;
+    Vec3 edge2 = v2 - v0;
 
     Vec3 h = Vec3::cross(ray.direction, edge2);
     float a = Vec3::dot(edge1, h);
@@ -324,7 +1065,7 @@ bool Raytracer::intersect_triangle( const RenderPrimitive& prim, const Ray& ray,
     }
 
     float f = 1.0f / a;
-    Vec3 s = ray.origin - prim.tri_v0;
+    Vec3 s = ray.origin - v0;
     float u = f * Vec3::dot(s, h);
 
     if (u < 0.0f || u > 1.0f) {
@@ -344,86 +1085,214 @@ bool Raytracer::intersect_triangle( const RenderPrimitive& prim, const Ray& ray,
         return false;
     }
 
+    set_triangle_hit(tri, ray, t, u, v, rec);
+    return true;
+}
+
+void Raytracer::set_triangle_hit(const RenderTriangle& tri, const Ray& ray, float t, float u, float v, Intersection& rec) const
+{
+    const RenderMesh& mesh = scene.meshes[tri.mesh_id];
+    const uint32_t* idx = &mesh.indices[tri.tri_index * 3];
+
     rec.t = t;
     rec.point = ray.at(rec.t);
 
     // interpolate normal using barycentric coords
     float w = 1.0f - u - v;
-    Vec3 interpolated_normal = prim.tri_n0 * w + prim.tri_n1 * u + prim.tri_n2 * v;
+    Vec3 interpolated_normal = mesh.normals[idx[0]] * w + mesh.normals[idx[1]] * u + mesh.normals[idx[2]] * v;
     rec.set_face_normal(ray, interpolated_normal.normalised());
 
-    rec.material = prim.material;
-
-    return true;
+    rec.material_id = mesh.material_id;
 }
 
-// note..recursive, not sure if this will be a problem for gpu accel later
-Colour Raytracer::ray_colour(const Ray& ray, int depth, uint64_t& rng) const
+// iterative, the path carries a running throughput rather than each bounce
+// multiplying on the way back up the stack
+void Raytracer::trace_path(PathState& path) const
 {
-    if (depth <= 0) return Colour(0, 0, 0);
-
-    Intersection rec;
-    //TODO shirley-style "interval" here? maybe call it RayRange/t_range
-    if (intersect(ray, 0.001f, std::numeric_limits<float>::infinity(), rec)) {
-       
-        if (rec.material.type == MaterialType::Emissive) {
-            return rec.material.emission;
+    while (path.active) {
+        Intersection rec;
+        //TODO shirley-style "interval" here? maybe call it RayRange/t_range
+        if (intersect(path.ray, 0.001f, std::numeric_limits<float>::infinity(), rec)) {
+            shade_hit(path, rec);
         }
+        else {
+            shade_miss(path);
+        }
+    }
+}
 
-        // russian roulette termination of rays.  on cornell box, about +11% perf
-        if (depth < 4) {  // after a few bounces
-            float p = std::max(rec.material.albedo.r,
-                std::max(rec.material.albedo.g, rec.material.albedo.b));
-            if (random_float(rng) > p) {
-                return Colour(0, 0, 0);  // terminate early
-            }
-            // boost surviving rays
-            rec.material.albedo = rec.material.albedo / p;
+void Raytracer::shade_hit(PathState& path, const Intersection& rec) const
+{
+    const Material& mat = scene.materials[rec.material_id];
+
+    if (path.bounces == 0) {
+        path.first_albedo = surface_albedo(mat, rec);
+        path.first_normal = rec.normal;
+        path.first_depth = rec.t;
+        path.first_material_id = int(rec.material_id);
+        path.first_prim_id = int(rec.prim_id);
+    }
+    path.sampler.start_bounce(path.bounces);
+    path.bounces++;
+
+    if (mat.type == MaterialType::Emissive) {
+        // if light sampling could have picked this light too, only count our share
+        float mis_weight = 1.0f;
+        if (!path.specular && !lights.empty() && is_light(rec.prim_id)) {
+            float pdf_light = light_pdf(scene.primitives[rec.prim_id], path.ray.origin, rec.point);
+            mis_weight = power_heuristic(path.bsdf_pdf, pdf_light);
         }
+        path.radiance = path.radiance + path.throughput * mat.emission * mis_weight;
+        path.active = false;
+        return;
+    }
 
-        // scatter
-        Ray scattered;
-        Colour attenuation;
+    const bool diffuse = mat.type == MaterialType::Lambertian || mat.type == MaterialType::Chequerboard;
 
-        if (scatter(ray, rec, attenuation, scattered, rng)) {
-            Colour bounced = ray_colour(scattered, depth - 1, rng);
-            return Colour(
-                attenuation.r * bounced.r,
-                attenuation.g * bounced.g,
-                attenuation.b * bounced.b
-            );
+    // direct light before roulette, it's this bounce's contribution whether or not the path carries on.
+    // skipped on the last bounce, where a bsdf sample couldn't reach the light either
+    if (diffuse && path.depth > 1 && !lights.empty()) {
+        Colour albedo = mat.type == MaterialType::Chequerboard ? get_chequerboard_colour(rec.point, mat) : mat.albedo;
+        path.radiance = path.radiance + path.throughput * sample_lights(rec, albedo, path.sampler);
+    }
+
+    // russian roulette termination of rays.  on cornell box, about +11% perf
+    float rr_boost = 1.0f;
+    if (path.depth < 4) {  // after a few bounces
+        float p = std::max(mat.albedo.r,
+            std::max(mat.albedo.g, mat.albedo.b));
+        if (path.sampler.get(BounceDimension::RussianRoulette) > p) {
+            path.active = false;  // terminate early
+            thread_stats().roulette_kills++;
+            return;
         }
+        // boost surviving rays
+        rr_boost = p;
+    }
+
+    // scatter
+    Ray scattered;
+    Colour attenuation;
+
+    if (!scatter(path.ray, rec, mat, attenuation, scattered, path.sampler)) {
+        path.active = false;
+        return;
+    }
+
+    path.throughput = path.throughput * (attenuation / rr_boost);
+    path.ray = scattered;
 
-        return Colour(0, 0, 0);
+    // both diffuse scatters are cosine weighted
+    path.specular = !diffuse;
+    if (diffuse) {
+        path.bsdf_pdf = std::max(0.0f, Vec3::dot(rec.normal, scattered.direction.normalised())) / PI;
     }
+    path.depth--;
+    path.active = path.depth > 0;
+}
 
+void Raytracer::shade_miss(PathState& path) const
+{
     // background - sample from scene.sky
-    Colour sky_colour = scene.sky.sample(ray.direction);
-    return sky_colour;
+    path.radiance = path.radiance + path.throughput * scene.sky.sample(path.ray.direction);
+    path.active = false;
+
+    if (path.bounces == 0) {
+        // white, so albedo divides (eg the denoiser's) leave the sky as it is
+        path.first_albedo = Colour(1.0f, 1.0f, 1.0f);
+    }
 }
 
-bool Raytracer::scatter(const Ray& ray_in, const Intersection& rec, Colour& attenuation, Ray& scattered, uint64_t& rng) const
+Colour Raytracer::surface_albedo(const Material& mat, const Intersection& rec) const
 {
-    switch (rec.material.type)
+    switch (mat.type) {
+    case MaterialType::Chequerboard:
+        return get_chequerboard_colour(rec.point, mat);
+    case MaterialType::Dielectric:
+        return Colour(1.0f, 1.0f, 1.0f);
+    case MaterialType::Emissive: {
+        // lights are way past 1, clamp so they look like any other bright surface
+        Colour c = mat.emission;
+        c.clamp();
+        return c;
+    }
+    default:
+        return mat.albedo;
+    }
+}
+
+Colour Raytracer::sample_lights(const Intersection& rec, const Colour& albedo, Sampler& sampler) const
+{
+    // pick one light uniformly, then a point uniformly over its area
+    uint32_t pick = std::min(uint32_t(sampler.get(BounceDimension::LightPick) * float(lights.size())), uint32_t(lights.size() - 1));
+    const RenderPrimitive& light = scene.primitives[lights[pick]];
+
+    Vec3 light_point = light.quad_corner
+        + light.quad_u * sampler.get(BounceDimension::LightU)
+        + light.quad_v * sampler.get(BounceDimension::LightV);
+    Vec3 to_light = light_point - rec.point;
+    float dist = to_light.length();
+    if (dist < ALMOST_ZERO) return Colour(0.0f);
+
+    Vec3 dir = to_light / dist;
+    float cos_surface = Vec3::dot(rec.normal, dir);
+    if (cos_surface <= 0.0f) return Colour(0.0f); // light's behind us
+
+    float pdf_light = light_pdf(light, rec.point, light_point);
+    if (pdf_light <= 0.0f) return Colour(0.0f);
+
+    if (occluded(Ray(rec.point, dir), 0.001f, dist - 0.001f)) return Colour(0.0f);
+
+    // lambertian brdf is albedo/pi, sampled with pdf cos/pi
+    float pdf_bsdf = cos_surface / PI;
+    float mis_weight = power_heuristic(pdf_light, pdf_bsdf);
+
+    const Colour& emission = scene.materials[light.material_id].emission;
+    return albedo * emission * (cos_surface / PI * mis_weight / pdf_light);
+}
+
+bool Raytracer::is_light(uint32_t prim_id) const
+{
+    if (prim_id >= scene.primitives.size()) return false;
+    const RenderPrimitive& prim = scene.primitives[prim_id];
+    return prim.type == RenderPrimitive::Type::Quad
+        && scene.materials[prim.material_id].type == MaterialType::Emissive;
+}
+
+float Raytracer::light_pdf(const RenderPrimitive& light, const Vec3& from, const Vec3& point) const
+{
+    // uniform over area, converted to solid angle.  quads emit from both sides, same as shade_hit
+    float area = Vec3::cross(light.quad_u, light.quad_v).length();
+    Vec3 to_light = point - from;
+    float dist_sq = Vec3::dot(to_light, to_light);
+    float cos_light = std::abs(Vec3::dot(light.quad_normal, to_light)) / std::sqrt(dist_sq);
+    if (area < ALMOST_ZERO || cos_light < ALMOST_ZERO) return 0.0f;
+
+    return dist_sq / (cos_light * area) / float(lights.size());
+}
+
+bool Raytracer::scatter(const Ray& ray_in, const Intersection& rec, const Material& mat, Colour& attenuation, Ray& scattered, Sampler& sampler) const
+{
+    switch (mat.type)
     {
         case MaterialType::Lambertian:
-            return scatter_lambertian(ray_in, rec, attenuation, scattered, rng);
+            return scatter_lambertian(ray_in, rec, mat, attenuation, scattered, sampler);
         case MaterialType::Metal:
-            return scatter_metal(ray_in, rec, attenuation, scattered, rng);
+            return scatter_metal(ray_in, rec, mat, attenuation, scattered, sampler);
         case MaterialType::Dielectric:
-            return scatter_dielectric(ray_in, rec, attenuation, scattered, rng);
+            return scatter_dielectric(ray_in, rec, mat, attenuation, scattered, sampler);
         case MaterialType::Chequerboard:
-            attenuation = get_chequerboard_colour(rec.point, rec.material);
-            scattered = Ray(rec.point, rec.normal + random_unit_vector(rng));
+            attenuation = get_chequerboard_colour(rec.point, mat);
+            scattered = Ray(rec.point, rec.normal + random_unit_vector(sampler));
             return true;
         default:
             return false;
     }
 }
 
-bool Raytracer::scatter_lambertian(const Ray& ray_in, const Intersection& rec, Colour& attenuation, Ray& scattered, uint64_t& rng) const
+bool Raytracer::scatter_lambertian(const Ray& ray_in, const Intersection& rec, const Material& mat, Colour& attenuation, Ray& scattered, Sampler& sampler) const
 {
-    Vec3 scatter_dir = rec.normal + random_unit_vector(rng);
+    Vec3 scatter_dir = rec.normal + random_unit_vector(sampler);
 
     // catch degenerate scatter direction
     if (std::abs(scatter_dir.x) < ALMOST_ZERO &&
@@ -433,28 +1302,28 @@ bool Raytracer::scatter_lambertian(const Ray& ray_in, const Intersection& rec, C
     }
 
     scattered = Ray(rec.point, scatter_dir.normalised());
-    attenuation = rec.material.albedo;
+    attenuation = mat.albedo;
 
     return true;
 }
 
-bool Raytracer::scatter_metal(const Ray& ray_in, const Intersection& rec, Colour& attenuation, Ray& scattered, uint64_t& rng) const
+bool Raytracer::scatter_metal(const Ray& ray_in, const Intersection& rec, const Material& mat, Colour& attenuation, Ray& scattered, Sampler& sampler) const
 {
     Vec3 reflected = reflect(ray_in.direction.normalised(), rec.normal);
 
     //TEMP adding roughness by perturbing reflection 
     //TODO: read pbrt microfacet roughness chapter
-    Vec3 fuzz = random_unit_vector(rng) * rec.material.roughness;
+    Vec3 fuzz = random_unit_vector(sampler) * mat.roughness;
     scattered = Ray(rec.point, (reflected + fuzz).normalised());
-    attenuation = rec.material.albedo;
+    attenuation = mat.albedo;
 
     return Vec3::dot(scattered.direction, rec.normal) > 0;
 }
 
-bool Raytracer::scatter_dielectric(const Ray& ray_in, const Intersection& rec, Colour& attenuation, Ray& scattered, uint64_t& rng) const
+bool Raytracer::scatter_dielectric(const Ray& ray_in, const Intersection& rec, const Material& mat, Colour& attenuation, Ray& scattered, Sampler& sampler) const
 {
     attenuation = Colour(1, 1, 1);
-    float refraction_ratio = rec.front_face ? (1.0f / rec.material.ior) : rec.material.ior;
+    float refraction_ratio = rec.front_face ? (1.0f / mat.ior) : mat.ior;
 
     Vec3 unit_dir = ray_in.direction.normalised();
     float cos_theta = std::min(Vec3::dot(unit_dir * -1.0f, rec.normal), 1.0f);
@@ -464,7 +1333,7 @@ bool Raytracer::scatter_dielectric(const Ray& ray_in, const Intersection& rec, C
     Vec3 direction;
 
     // schlick approx
-    if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_float(rng)) {
+    if (cannot_refract || reflectance(cos_theta, refraction_ratio) > sampler.get(BounceDimension::BsdfChoice)) {
         direction = reflect(unit_dir, rec.normal);
     }
     else {
@@ -487,23 +1356,14 @@ Colour Raytracer::get_chequerboard_colour(const Vec3& point, const Material& mat
     return is_even ? mat.chequerboard_colour_a : mat.chequerboard_colour_b;
 }
 
-Vec3 Raytracer::random_in_unit_sphere(uint64_t& rng) const
-{
-    while (true) {
-        Vec3 p(
-            random_float(rng) * 2.0f - 1.0f,
-            random_float(rng) * 2.0f - 1.0f,
-            random_float(rng) * 2.0f - 1.0f
-        );
-        if (Vec3::dot(p, p) < 1.0f) {
-            return p;
-        }
-    }
-}
-
-Vec3 Raytracer::random_unit_vector(uint64_t& rng) const
+Vec3 Raytracer::random_unit_vector(Sampler& sampler) const
 {
-    return random_in_unit_sphere(rng).normalised();
+    // uniform on the sphere straight from two dimensions, rejection sampling would
+    // eat an unknown number of them and throw off every later decision's stratification
+    float z = 1.0f - 2.0f * sampler.get(BounceDimension::BsdfU);
+    float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    float phi = 2.0f * PI * sampler.get(BounceDimension::BsdfV);
+    return Vec3(r * std::cos(phi), r * std::sin(phi), z);
 }
 
 Vec3 Raytracer::reflect(const Vec3& v, const Vec3& n) const
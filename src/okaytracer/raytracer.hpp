@@ -1,7 +1,15 @@
 #pragma once
 
 #include "ray.hpp"
+#include "ray_packet.hpp"
 #include "render_scene.hpp"
+#include "bvh.hpp"
+#include "bvh4.hpp"
+#include "thread_pool.hpp"
+#include "denoiser.hpp"
+#include "triple_buffer.hpp"
+#include "sampler.hpp"
+#include "render_stats.hpp"
 #include "../core/camera.hpp"
 
 #ifdef OLLYGON_USE_OPTIX
@@ -9,27 +17,70 @@
 #endif
 
 #include <vector>
+#include <memory>
+#include <string>
 #include <cstdint>
 #include <random>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 
 
 namespace ollygon {
 namespace okaytracer {
 
 enum class RenderBackend {
-    CPU,
+    CPU,          // megakernel style, each pixel's path traced start to finish
+    CPUWavefront, // tile-wide ray batches, shading grouped by material
     OptiX
 };
 
+// arbitrary output variables, extra per-pixel buffers filled from the same paths
+// as the beauty.  the ids are from the first sample a pixel takes, averaging
+// them would be meaningless, everything else accumulates like pixels
+enum class Aov {
+    Depth,       // 1 channel, distance to the camera ray's hit, 0 on a miss
+    Normal,      // 3, world space at the first hit, facing the camera
+    Albedo,      // 3, first hit's surface colour, white on a miss
+    MaterialId,  // 1, into RenderScene::materials, -1 on a miss
+    PrimitiveId, // 1, bvh item (into primitives then triangles), -1 on a miss
+    BounceCount, // 1, surfaces the path hit before it ended
+    Count
+};
+
+constexpr int AOV_COUNT = int(Aov::Count);
+
+constexpr uint32_t aov_bit(Aov aov) { return 1u << int(aov); }
+
+constexpr int aov_channels(Aov aov) {
+    return (aov == Aov::Normal || aov == Aov::Albedo) ? 3 : 1;
+}
+
+// what Raytracer::denoise() filters with
+constexpr uint32_t DENOISER_AOVS = aov_bit(Aov::Depth) | aov_bit(Aov::Normal) | aov_bit(Aov::Albedo);
+
 struct RenderConfig {
     int width;
     int height;
     int samples_per_pixel;
     int max_bounces;
     uint64_t seed;
+    // index of this render's first pass in the sample sequence.  renders of disjoint
+    // ranges with the same seed take the same samples one render of the lot would,
+    // so their accumulations can be averaged together, weighted by sample count
+    int first_sample;
     RenderBackend backend;
+    bool packet_primary_rays; // CPU backend: trace camera rays 2x2 pixels at a time
+    bool light_sampling;      // CPU backends: next event estimation on emissive quads, MIS'd with bsdf samples
+    SamplerType sampler;      // CPU backends
+
+    // adaptive sampling, CPU backends.  a tile stops once its pixels' mean relative standard
+    // error (of luminance) is under noise_threshold, samples_per_pixel is then just the cap.  0 disables
+    float noise_threshold;
+    int min_samples; // before a tile can be judged converged, so a lucky few samples can't end it
+
+    uint32_t aovs; // aov_bit()s to write, CPU backends
 
     RenderConfig()
         : width(600)
@@ -37,10 +88,26 @@ struct RenderConfig {
         , samples_per_pixel(1000)
         , max_bounces(7)
         , seed(1)
+        , first_sample(0)
         , backend(RenderBackend::CPU)
+        , packet_primary_rays(true)
+        , light_sampling(true)
+        , sampler(SamplerType::Sobol)
+        , noise_threshold(0.01f)
+        , min_samples(16)
+        , aovs(DENOISER_AOVS)
     {}
 };
 
+struct Tile {
+    int start_x, end_x;
+    int start_y, end_y;
+
+    int samples;      // taken so far
+    float error;      // mean relative standard error of its pixels after the last sample
+    bool converged;   // no more samples needed
+};
+
 struct CameraBasis {
     Vec3 viewport_upper_left;
     Vec3 pixel_delta_u;
@@ -48,71 +115,288 @@ struct CameraBasis {
     Vec3 camera_pos;
 };
 
+// everything a path carries between bounces, so the integrator is a flat loop
+// (and a batch of these can be stepped together) instead of recursing
+struct PathState {
+    Ray ray;
+    Colour throughput; // product of attenuations so far
+    Colour radiance;   // light gathered so far, already weighted by throughput
+    int depth;         // bounces remaining, counts down like the old recursive depth
+    Sampler sampler;
+    bool active;
+
+    // how ray was chosen, for MIS weighting whatever light it hits
+    float bsdf_pdf; // solid angle pdf of ray's direction
+    bool specular;  // ray wasn't from a diffuse bounce (or is the camera ray), so light sampling couldn't have found it
+
+    // what the camera ray saw, for the aovs
+    int bounces; // surfaces hit so far
+    Colour first_albedo;
+    Vec3 first_normal;
+    float first_depth; // 0 on a miss
+    int first_material_id; // -1 on a miss
+    int first_prim_id;
+
+    PathState(const Ray& _ray, int _depth, const Sampler& _sampler)
+        : ray(_ray)
+        , throughput(1.0f, 1.0f, 1.0f)
+        , radiance(0.0f, 0.0f, 0.0f)
+        , depth(_depth)
+        , sampler(_sampler)
+        , active(_depth > 0)
+        , bsdf_pdf(0.0f)
+        , specular(true)
+        , bounces(0)
+        , first_albedo(0.0f, 0.0f, 0.0f)
+        , first_normal(0.0f, 0.0f, 0.0f)
+        , first_depth(0.0f)
+        , first_material_id(-1)
+        , first_prim_id(-1)
+    {}
+};
+
+// snapshot of the accumulation, handed from the render thread to whoever displays it
+struct RenderFrame {
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;
+    std::vector<float> denoised; // empty unless preview denoising is on
+    int samples = 0;             // passes taken
+    float progress = 0.0f;
+    RenderStats stats;           // totals so far, as get_stats()
+
+    // for redrawing only what changed.  a tile's pixels only change when its
+    // samples do, so comparing against the tiles last shown finds them, as long
+    // as render_id (new every start_render or resume) is the same.  empty for
+    // OptiX, which doesn't work in tiles
+    std::vector<Tile> tiles;
+    uint64_t render_id = 0;
+    uint64_t denoise_revision = 0; // bumped whenever denoised is refiltered
+};
+
+// up to 4 mesh tris from one BVH4 leaf, pre-subtracted and SoA so a single
+// ray tests them all at once.  unused lanes are degenerate and never hit
+struct TriangleBlock4 {
+    Float4 v0_x, v0_y, v0_z;
+    Float4 edge1_x, edge1_y, edge1_z;
+    Float4 edge2_x, edge2_y, edge2_z;
+    uint32_t triangle[4]; // into RenderScene::triangles (tri within the mesh in a MeshAccel), or NO_HIT
+};
+
+// what's in each BVH4 leaf, parallel to Bvh4::get_leaves()
+struct LeafGeometry {
+    uint32_t first_block, block_count;       // into triangle_blocks
+    uint32_t first_prim, prim_count;         // into leaf_prims, analytic prims stay scalar
+    uint32_t first_instance, instance_count; // into leaf_instances
+};
+
+// bottom level of the two level structure, one per instanced mesh and in its
+// object space.  leaves only ever hold triangle blocks
+struct MeshAccel {
+    Bvh4 bvh4;
+    std::vector<LeafGeometry> leaf_geometry;
+    std::vector<TriangleBlock4> triangle_blocks;
+    Aabb bounds;
+};
+
+class RaytracerBenchmark;
+
 class Raytracer {
+    friend class RaytracerBenchmark; // tools/ollygon_bench.cpp, times the intersect_* routines directly
 public:
-    Raytracer();
+    explicit Raytracer(int threads = 0); // 0 for one per hardware thread
     ~Raytracer();
 
+    // sets up a render, stopping any that's running.  then either step it with
+    // render_one_sample() or hand it to a background thread with render_async()
     void start_render(const RenderScene& scene, const Camera& camera, const RenderConfig& new_config);
+    // same, converting the scene itself.  given the same scene again it only
+    // converts the nodes edited since (see SceneNode::mark_dirty) and only
+    // rebuilds the acceleration if something moved, so re-rendering after a
+    // material tweak starts straight away.  scene must outlive the next call
+    void start_render(const Scene* scene, const Camera& camera, const RenderConfig& new_config);
+
+    // samples on a thread of our own until done or stopped, publishing a frame
+    // after each pass.  the getters below belong to that thread until it finishes,
+    // read frames through acquire_frame()/get_frame() meanwhile
+    void render_async();
 
+    // cancels mid-pass (between tiles) and waits for the render thread
     void stop_render();
-    bool is_rendering() const { return rendering; }
-    float get_progress() const;
+    bool is_rendering() const { return rendering || thread_active; }
+
+    // UI side.  picks up the newest published frame, returns false if nothing new
+    bool acquire_frame() { return frames.acquire(); }
+    const RenderFrame& get_frame() const { return frames.read_buffer(); }
+    // denoise frames before publishing, refiltered every DENOISE_INTERVAL rather than
+    // every pass.  publishes straight away when the render thread isn't running
+    void set_preview_denoise(bool enabled);
+
+    float get_progress() const; // fraction of the worst case work done, converged tiles count as finished
+    int get_current_sample() const { return current_sample; }
 
     const std::vector<float>& get_pixels() const { return pixels; }
+
+    // CPU backends' counters for the last pass and summed since start_render
+    const RenderStats& get_sample_stats() const { return sample_stats; }
+    const RenderStats& get_stats() const { return total_stats; }
+    // aov_channels(aov) floats per pixel, empty unless the aov was in config.aovs
+    const std::vector<float>& get_aov(Aov aov) const { return aov_buffers[int(aov)]; }
+    bool has_aov(Aov aov) const { return (config.aovs & aov_bit(aov)) != 0; }
+
+    // filters the current pixels with the a-trous denoiser, guided by the depth/normal/albedo
+    // aovs.  doesn't touch pixels, so can be called every preview.  without the aovs it
+    // has nothing to guide it and hands back pixels as they are
+    const std::vector<float>& denoise();
+    Denoiser::Settings& get_denoiser_settings() { return denoiser.settings; }
     int get_width() const { return config.width; }
     int get_height() const { return config.height; }
 
+    // checkpoints, so a long render that gets pre-empted can carry on later.  only
+    // between passes, never while render_async()'s thread is going.  scene_hash is
+    // the caller's, whatever tells it the scene and camera are the same ones (eg a
+    // hash of the scene file).  written to path.tmp then renamed over path, so a
+    // crash mid-write leaves the last good checkpoint
+    bool save_checkpoint(const std::string& path, uint64_t scene_hash) const;
+    // after start_render() with the checkpoint's config (samples_per_pixel aside,
+    // so a render can be resumed with a higher cap), carries on accumulating where
+    // it stopped.  false, leaving the fresh render as it was, if it doesn't match
+    bool resume_checkpoint(const std::string& path, uint64_t scene_hash);
+
     void render_one_sample();
 
     void render_tile(int start_x, int end_x, int start_y, int end_y, const CameraBasis& basis);
+    void render_tile_wavefront(int start_x, int end_x, int start_y, int end_y, const CameraBasis& basis);
+    void render_tile_packets(int start_x, int end_x, int start_y, int end_y, const CameraBasis& basis);
 
     uint64_t hash_pixel(int x, int y, uint64_t seed) const;
+    Sampler make_sampler(int x, int y) const; // for this pass's sample of the pixel
 
     RenderBackend get_active_backend() const { return active_backend; }
+    int get_thread_count() const { return thread_pool->size(); }
 
 private:
     CameraBasis compute_camera_basis() const;
+    void build_tiles();
+    void render_loop();
+    void publish_frame(bool force_denoise);
+    void accumulate_tile(Tile& tile); // fold the tile's sample_buffer into pixels, then check convergence
+    void merge_thread_stats(double wall_ms); // end of a pass, into sample_stats and total_stats
+
+    // this thread's counters, only touched by the thread they belong to
+    RenderStats& thread_stats() const { return worker_stats[ThreadPool::thread_index()]; }
+
+    // start_render()'s shared tail, once scene holds what's to be rendered
+    void begin_render(const RenderSceneChanges& changes, const Camera& new_camera, const RenderConfig& new_config);
+
+    void build_acceleration();
+    // updates the bvhs in place for what changes moved, false (having done
+    // nothing useful) if the tree's degraded enough that it should be rebuilt
+    bool refit_acceleration(const RenderSceneChanges& changes);
+    void build_mesh_accel(uint32_t mesh_id);
+    // appends SIMD blocks for the leaf's tris, skipping its prims and instances
+    void pack_leaf_triangles(const Bvh4Leaf& leaf, std::vector<TriangleBlock4>& blocks) const;
+    void build_lights();
 
     bool intersect(const Ray& ray, float t_min, float t_max, Intersection& rec) const;
+    bool occluded(const Ray& ray, float t_min, float t_max) const;
+    // item is a bvh prim index, ie into primitives then triangles then instances
+    bool intersect_item(uint32_t item, const Ray& ray, float t_min, float t_max, Intersection& rec) const;
+    bool intersect_primitive(const RenderPrimitive& prim, const Ray& ray, float t_min, float t_max, Intersection& rec) const;
     bool intersect_sphere(const RenderPrimitive& prim, const Ray& ray, float t_min, float t_max, Intersection& rec) const;
     bool intersect_quad(const RenderPrimitive& prim, const Ray& ray, float t_min, float t_max, Intersection& rec) const;
-    bool intersect_triangle(const RenderPrimitive& prim, const Ray& ray, float t_min, float t_max, Intersection& rec) const;
+    bool intersect_triangle(const RenderTriangle& tri, const Ray& ray, float t_min, float t_max, Intersection& rec) const;
+    void set_triangle_hit(const RenderTriangle& tri, const Ray& ray, float t, float u, float v, Intersection& rec) const;
+    bool intersect_leaf(const LeafGeometry& leaf, const Ray& ray, float t_min, float t_max, Intersection& rec) const;
+    // mesh_id is NO_HIT for the top level's blocks, or the mesh a MeshAccel's blocks belong to
+    bool intersect_triangle_block(const TriangleBlock4& block, uint32_t mesh_id, const Ray& ray, float t_min, float t_max, Intersection& rec) const;
+    // ray moved into the instance's object space and through its MeshAccel, rec comes back in world space
+    bool intersect_instance(uint32_t instance_index, const Ray& ray, float t_min, float t_max, Intersection& rec) const;
+
+    // packet versions only find the closest t and item per lane, the full
+    // Intersection is filled in afterwards with a scalar intersect_item()
+    bool intersect_packet(RayPacket& packet, float t_min) const;
+    bool intersect_sphere_packet(const RenderPrimitive& prim, RayPacket& packet, float t_min, uint32_t item) const;
+    bool intersect_quad_packet(const RenderPrimitive& prim, RayPacket& packet, float t_min, uint32_t item) const;
+    bool intersect_triangle_packet(const RenderTriangle& tri, RayPacket& packet, float t_min, uint32_t item) const;
+    bool intersect_instance_packet(uint32_t instance_index, RayPacket& packet, float t_min, uint32_t item) const; // lane by lane
+
+    void write_sample(int pixel, const PathState& path); // into this pass's sample and aov buffers
+    void trace_path(PathState& path) const; // bounce until the path terminates
+    // one bounce of the integrator, either side of intersect()
+    void shade_hit(PathState& path, const Intersection& rec) const;
+    void shade_miss(PathState& path) const;
+    Colour surface_albedo(const Material& mat, const Intersection& rec) const;
 
-    Colour ray_colour(const Ray& ray, int depth, uint64_t& rng) const;
-    bool scatter(const Ray& ray_in, const Intersection& rec, Colour& attenuation, Ray& scattered, uint64_t& rng) const;
+    // next event estimation from a diffuse hit, MIS weighted against the bsdf sample
+    Colour sample_lights(const Intersection& rec, const Colour& albedo, Sampler& sampler) const;
+    bool is_light(uint32_t prim_id) const;
+    float light_pdf(const RenderPrimitive& light, const Vec3& from, const Vec3& point) const; // solid angle, includes picking it
+    bool scatter(const Ray& ray_in, const Intersection& rec, const Material& mat, Colour& attenuation, Ray& scattered, Sampler& sampler) const;
 
     // mat scattering funcs
-    bool scatter_lambertian(const Ray& rain_in, const Intersection& rec, Colour& attenuation, Ray& scattered, uint64_t& rng) const;
-    bool scatter_metal(const Ray& rain_in, const Intersection& rec, Colour& attenuation, Ray& scattered, uint64_t& rng) const;
-    bool scatter_dielectric(const Ray& rain_in, const Intersection& rec, Colour& attenuation, Ray& scattered, uint64_t& rng) const;
+    bool scatter_lambertian(const Ray& rain_in, const Intersection& rec, const Material& mat, Colour& attenuation, Ray& scattered, Sampler& sampler) const;
+    bool scatter_metal(const Ray& rain_in, const Intersection& rec, const Material& mat, Colour& attenuation, Ray& scattered, Sampler& sampler) const;
+    bool scatter_dielectric(const Ray& rain_in, const Intersection& rec, const Material& mat, Colour& attenuation, Ray& scattered, Sampler& sampler) const;
     Colour get_chequerboard_colour(const Vec3& point, const Material& mat) const;
 
-    Vec3 random_in_unit_sphere(uint64_t& rng) const;
-    Vec3 random_unit_vector(uint64_t& rng) const;
+    Vec3 random_unit_vector(Sampler& sampler) const; // from the bounce's bsdf dimensions
     Vec3 reflect(const Vec3& v, const Vec3& n) const;
     Vec3 refract(const Vec3& v, const Vec3& n, float etai_over_etat) const;
     float reflectance(float cosine, float ref_idx) const;
 
     RenderScene scene;
+    const Scene* source_scene = nullptr; // what scene was converted from, if start_render() did it
+    bool cpu_accel_current = false;      // bvh and friends match scene
+    bool gpu_scene_current = false;      // the OptiX GAS matches scene
+    Bvh bvh; // over scene.primitives, scene.triangles then scene.instances, CPU backends only
+    std::vector<Aabb> item_bounds; // what bvh was built or last refit over
+    std::vector<uint32_t> mesh_first_triangle; // into scene.triangles by mesh id, NO_HIT for instanced ones
+    float built_sah_cost = 0.0f;
+    // refits keep going until the tree's SAH cost is this much worse than when it was built
+    static constexpr float REFIT_SAH_LIMIT = 1.5f;
+    Bvh4 bvh4; // collapsed from bvh, used for single rays.  packets stay on the binary tree
+    std::vector<LeafGeometry> leaf_geometry;
+    std::vector<TriangleBlock4> triangle_blocks;
+    std::vector<uint32_t> leaf_prims;
+    std::vector<uint32_t> leaf_instances; // into scene.instances
+    std::vector<MeshAccel> mesh_accels;   // by mesh id, empty for the world space meshes
+    std::vector<uint32_t> lights; // emissive quads, into scene.primitives.  empty when light_sampling is off
     Camera camera;
     RenderConfig config;
 
     std::vector<float> pixels;
     std::vector<float> sample_buffer;
+    std::vector<float> aov_samples[AOV_COUNT]; // this pass, like sample_buffer.  empty when not enabled
+    std::vector<float> aov_buffers[AOV_COUNT]; // accumulated, like pixels
+    std::vector<float> luminance_mean; // per pixel, running welford stats for adaptive sampling
+    std::vector<float> luminance_m2;
+    std::vector<Tile> tiles;
+    std::vector<int> active_tiles; // into tiles, those still being sampled
+
+    mutable std::vector<RenderStats> worker_stats; // one per pool thread, by ThreadPool::thread_index()
+    RenderStats sample_stats;
+    RenderStats total_stats;
+
+    Denoiser denoiser;
+    std::vector<float> pixel_variance; // denoiser input, rebuilt from the welford stats
+    std::vector<float> denoised_pixels;
 
-    bool rendering;
+    std::atomic<bool> rendering;
     int current_sample;
 
-    float random_float(uint64_t& state) const {
-        // from https://en.wikipedia.org/wiki/Xorshift with added state by reference to force thread-locality
-        state ^= state >> 12;
-        state ^= state << 25;
-        state ^= state >> 27;
-        return float((state * 0x2545F4914F6CDD1DULL) >> 33) / float(1ULL << 31);
-    }
+    std::thread render_thread;
+    std::atomic<bool> thread_active; // until the last frame is published, rendering drops a pass earlier
+    std::atomic<bool> cancel_requested;
+    TripleBuffer<RenderFrame> frames;
+    std::atomic<bool> preview_denoise;
+    std::chrono::steady_clock::time_point last_denoise;
+    uint64_t denoise_revision = 0;
+    uint64_t render_id = 0; // see RenderFrame
+    static constexpr std::chrono::milliseconds DENOISE_INTERVAL{ 250 };
 
     int num_threads = std::thread::hardware_concurrency();
+    std::unique_ptr<ThreadPool> thread_pool; // lives as long as we do, reused every sample
 
     //GPU
 #ifdef OLLYGON_USE_OPTIX
@@ -0,0 +1,276 @@
+#define NOMINMAX
+
+// saving and resuming a render's accumulation.  a checkpoint is everything a
+// pass leaves behind: the pixels and aovs, each tile's sample count and
+// convergence, and the welford stats adaptive sampling judges tiles on, so a
+// resumed render takes the same passes the uninterrupted one would have
+
+#include "raytracer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+namespace ollygon {
+namespace okaytracer {
+
+namespace {
+
+const char CHECKPOINT_MAGIC[8] = { 'O', 'L', 'L', 'Y', 'C', 'K', 'P', 'T' };
+const uint32_t CHECKPOINT_VERSION = 1;
+
+// the config as written, field by field so padding never reaches the file
+struct CheckpointConfig {
+    int32_t width, height;
+    int32_t samples_per_pixel, max_bounces;
+    uint64_t seed;
+    int32_t first_sample;
+    int32_t backend, packet_primary_rays, light_sampling, sampler;
+    float noise_threshold;
+    int32_t min_samples;
+    uint32_t aovs;
+};
+
+CheckpointConfig checkpoint_config(const RenderConfig& config) {
+    CheckpointConfig c;
+    c.width = config.width;
+    c.height = config.height;
+    c.samples_per_pixel = config.samples_per_pixel;
+    c.max_bounces = config.max_bounces;
+    c.seed = config.seed;
+    c.first_sample = config.first_sample;
+    c.backend = int32_t(config.backend);
+    c.packet_primary_rays = config.packet_primary_rays;
+    c.light_sampling = config.light_sampling;
+    c.sampler = int32_t(config.sampler);
+    c.noise_threshold = config.noise_threshold;
+    c.min_samples = config.min_samples;
+    c.aovs = config.aovs;
+    return c;
+}
+
+// everything that changes what a pass adds.  the cap only says when to stop
+bool same_render(const CheckpointConfig& a, const CheckpointConfig& b) {
+    return a.width == b.width && a.height == b.height
+        && a.max_bounces == b.max_bounces
+        && a.seed == b.seed && a.first_sample == b.first_sample
+        && a.backend == b.backend && a.packet_primary_rays == b.packet_primary_rays
+        && a.light_sampling == b.light_sampling && a.sampler == b.sampler
+        && a.noise_threshold == b.noise_threshold && a.min_samples == b.min_samples
+        && a.aovs == b.aovs;
+}
+
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(FILE* file) : file(file) {}
+
+    void write(const void* data, size_t size) {
+        if (size > 0 && std::fwrite(data, 1, size, file) != size) ok = false;
+    }
+    template <typename T>
+    void write_value(const T& value) { write(&value, sizeof(T)); }
+    void write_floats(const std::vector<float>& values) {
+        write_value(uint64_t(values.size()));
+        write(values.data(), values.size() * sizeof(float));
+    }
+
+    FILE* file;
+    bool ok = true;
+};
+
+class CheckpointReader {
+public:
+    explicit CheckpointReader(FILE* file) : file(file) {}
+
+    void read(void* data, size_t size) {
+        if (ok && size > 0 && std::fread(data, 1, size, file) != size) ok = false;
+    }
+    template <typename T>
+    void read_value(T& value) { read(&value, sizeof(T)); }
+    // expected_size has to match, so a mismatched file can't have us allocate garbage
+    void read_floats(std::vector<float>& values, size_t expected_size) {
+        uint64_t size = 0;
+        read_value(size);
+        if (size != expected_size) {
+            ok = false;
+            return;
+        }
+        values.resize(expected_size);
+        read(values.data(), expected_size * sizeof(float));
+    }
+
+    FILE* file;
+    bool ok = true;
+};
+
+} // namespace
+
+bool Raytracer::save_checkpoint(const std::string& path, uint64_t scene_hash) const
+{
+    const std::string temp_path = path + ".tmp";
+    FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "failed to open " << temp_path << " for writing\n";
+        return false;
+    }
+
+    CheckpointWriter writer(file);
+    writer.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    writer.write_value(CHECKPOINT_VERSION);
+    writer.write_value(scene_hash);
+
+    const CheckpointConfig c = checkpoint_config(config);
+    writer.write_value(c.width);
+    writer.write_value(c.height);
+    writer.write_value(c.samples_per_pixel);
+    writer.write_value(c.max_bounces);
+    writer.write_value(c.seed);
+    writer.write_value(c.first_sample);
+    writer.write_value(c.backend);
+    writer.write_value(c.packet_primary_rays);
+    writer.write_value(c.light_sampling);
+    writer.write_value(c.sampler);
+    writer.write_value(c.noise_threshold);
+    writer.write_value(c.min_samples);
+    writer.write_value(c.aovs);
+
+    writer.write_value(int32_t(current_sample));
+    writer.write_value(uint32_t(tiles.size()));
+    for (const Tile& tile : tiles) {
+        writer.write_value(int32_t(tile.samples));
+        writer.write_value(tile.error);
+        writer.write_value(uint8_t(tile.converged));
+    }
+
+    writer.write_floats(pixels);
+    writer.write_floats(luminance_mean);
+    writer.write_floats(luminance_m2);
+    for (int i = 0; i < AOV_COUNT; ++i) {
+        writer.write_floats(aov_buffers[i]);
+    }
+
+    bool ok = writer.ok && std::fflush(file) == 0 && std::ferror(file) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::cerr << "failed to write checkpoint " << temp_path << "\n";
+        std::remove(temp_path.c_str());
+        return false;
+    }
+
+    // replaces path in one step, readers only ever see the old checkpoint or the new
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        std::cerr << "failed to replace " << path << ": " << error.message() << "\n";
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Raytracer::resume_checkpoint(const std::string& path, uint64_t scene_hash)
+{
+    if (render_thread.joinable()) {
+        std::cerr << "can't resume a checkpoint while rendering asynchronously\n";
+        return false;
+    }
+
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "failed to open checkpoint " << path << "\n";
+        return false;
+    }
+
+    CheckpointReader reader(file);
+
+    char magic[sizeof(CHECKPOINT_MAGIC)] = {};
+    uint32_t version = 0;
+    uint64_t saved_hash = 0;
+    reader.read(magic, sizeof(magic));
+    reader.read_value(version);
+    reader.read_value(saved_hash);
+
+    CheckpointConfig saved;
+    reader.read_value(saved.width);
+    reader.read_value(saved.height);
+    reader.read_value(saved.samples_per_pixel);
+    reader.read_value(saved.max_bounces);
+    reader.read_value(saved.seed);
+    reader.read_value(saved.first_sample);
+    reader.read_value(saved.backend);
+    reader.read_value(saved.packet_primary_rays);
+    reader.read_value(saved.light_sampling);
+    reader.read_value(saved.sampler);
+    reader.read_value(saved.noise_threshold);
+    reader.read_value(saved.min_samples);
+    reader.read_value(saved.aovs);
+
+    const char* mismatch = nullptr;
+    if (!reader.ok || !std::equal(magic, magic + sizeof(magic), CHECKPOINT_MAGIC)) mismatch = "isn't a checkpoint";
+    else if (version != CHECKPOINT_VERSION) mismatch = "is from another version";
+    else if (saved_hash != scene_hash) mismatch = "is of a different scene";
+    else if (!same_render(saved, checkpoint_config(config))) mismatch = "was rendered with different settings";
+
+    if (mismatch) {
+        std::fclose(file);
+        std::cerr << "checkpoint " << path << " " << mismatch << ", not resuming\n";
+        return false;
+    }
+
+    // read into copies, a checkpoint cut short mustn't leave the render half loaded
+    int32_t saved_sample = 0;
+    uint32_t tile_count = 0;
+    reader.read_value(saved_sample);
+    reader.read_value(tile_count);
+    reader.ok = reader.ok && tile_count == tiles.size();
+
+    std::vector<Tile> saved_tiles = tiles;
+    for (Tile& tile : saved_tiles) {
+        if (!reader.ok) break;
+        int32_t samples = 0;
+        uint8_t converged = 0;
+        reader.read_value(samples);
+        reader.read_value(tile.error);
+        reader.read_value(converged);
+        tile.samples = samples;
+        tile.converged = converged != 0;
+    }
+
+    std::vector<float> saved_pixels, saved_mean, saved_m2;
+    std::vector<float> saved_aovs[AOV_COUNT];
+    reader.read_floats(saved_pixels, pixels.size());
+    reader.read_floats(saved_mean, luminance_mean.size());
+    reader.read_floats(saved_m2, luminance_m2.size());
+    for (int i = 0; i < AOV_COUNT; ++i) {
+        reader.read_floats(saved_aovs[i], aov_buffers[i].size());
+    }
+    std::fclose(file);
+
+    if (!reader.ok || saved_sample < 0) {
+        std::cerr << "checkpoint " << path << " is cut short, not resuming\n";
+        return false;
+    }
+
+    current_sample = saved_sample;
+    tiles = std::move(saved_tiles);
+    pixels = std::move(saved_pixels);
+    luminance_mean = std::move(saved_mean);
+    luminance_m2 = std::move(saved_m2);
+    for (int i = 0; i < AOV_COUNT; ++i) {
+        aov_buffers[i] = std::move(saved_aovs[i]);
+    }
+    denoised_pixels.clear();
+    render_id++;
+
+    active_tiles.clear();
+    for (int i = 0; i < int(tiles.size()); ++i) {
+        if (!tiles[i].converged) active_tiles.push_back(i);
+    }
+
+    rendering = current_sample < config.samples_per_pixel && !active_tiles.empty();
+    return true;
+}
+
+} // namespace okaytracer
+} // namespace ollygon
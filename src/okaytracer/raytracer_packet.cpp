@@ -0,0 +1,309 @@
+#define NOMINMAX
+
+// packet tracing of primary rays.  camera rays from a 2x2 pixel block leave the
+// same point in nearly the same direction, so they walk the BVH together and
+// each node/prim test covers 4 rays at once.  once the first hit is known the
+// paths are bounced one at a time through the usual scalar integrator, since
+// after a diffuse bounce they no longer share anything worth exploiting
+
+#include "raytracer.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+namespace ollygon {
+namespace okaytracer {
+
+namespace {
+
+constexpr int PACKET_BLOCK = 2; // PACKET_BLOCK^2 == PACKET_SIZE
+
+} // namespace
+
+void Raytracer::render_tile_packets(int start_x, int end_x, int start_y, int end_y, const CameraBasis& basis) {
+    const float infinity = std::numeric_limits<float>::infinity();
+
+    for (int block_y = start_y; block_y < end_y; block_y += PACKET_BLOCK) {
+        for (int block_x = start_x; block_x < end_x; block_x += PACKET_BLOCK) {
+            Ray rays[PACKET_SIZE];
+            Sampler samplers[PACKET_SIZE];
+            int pixel_indices[PACKET_SIZE]; // into pixels, not floats
+            int count = 0;
+
+            // blocks on the right/bottom tile edge can be partial
+            for (int y = block_y; y < std::min(block_y + PACKET_BLOCK, end_y); ++y) {
+                for (int x = block_x; x < std::min(block_x + PACKET_BLOCK, end_x); ++x) {
+                    // same sequence as the scalar path
+                    Sampler& sampler = samplers[count];
+                    sampler = make_sampler(x, y);
+
+                    float px = float(x) + sampler.get(CameraDimension::PixelX);
+                    float py = float(y) + sampler.get(CameraDimension::PixelY);
+
+                    Vec3 pixel_centre = basis.viewport_upper_left
+                        + basis.pixel_delta_u * px
+                        - basis.pixel_delta_v * py;
+
+                    rays[count] = Ray(basis.camera_pos, (pixel_centre - basis.camera_pos).normalised());
+                    pixel_indices[count] = y * config.width + x;
+                    count++;
+                }
+            }
+
+            RayPacket packet(rays, count, infinity);
+            if (config.max_bounces > 0) {
+                intersect_packet(packet, 0.001f);
+            }
+
+            for (int i = 0; i < count; ++i) {
+                PathState path(rays[i], config.max_bounces, samplers[i]);
+
+                if (path.active) {
+                    Intersection rec;
+                    bool hit = packet.hit_item[i] != NO_HIT
+                        && intersect_item(packet.hit_item[i], path.ray, 0.001f, infinity, rec);
+
+                    // the scalar test should always agree with the SIMD one, but if
+                    // rounding says otherwise, don't lose the hit - redo it properly
+                    if (packet.hit_item[i] != NO_HIT && !hit) {
+                        hit = intersect(path.ray, 0.001f, infinity, rec);
+                    }
+
+                    if (hit) {
+                        shade_hit(path, rec);
+                    }
+                    else {
+                        shade_miss(path);
+                    }
+                    trace_path(path);
+                }
+
+                write_sample(pixel_indices[i], path);
+            }
+        }
+    }
+}
+
+bool Raytracer::intersect_packet(RayPacket& packet, float t_min) const
+{
+    const uint32_t num_prims = uint32_t(scene.primitives.size());
+    const uint32_t first_instance = num_prims + uint32_t(scene.triangles.size());
+
+    RenderStats& stats = thread_stats();
+    stats.rays += std::popcount(unsigned(movemask(packet.active)));
+
+    return bvh.traverse_packet(packet, t_min, [&](uint32_t prim_index, RayPacket& p) {
+        stats.primitive_tests += std::popcount(unsigned(movemask(p.active)));
+        if (prim_index >= first_instance) {
+            return intersect_instance_packet(prim_index - first_instance, p, t_min, prim_index);
+        }
+        if (prim_index >= num_prims) {
+            return intersect_triangle_packet(scene.triangles[prim_index - num_prims], p, t_min, prim_index);
+        }
+
+        const RenderPrimitive& prim = scene.primitives[prim_index];
+        switch (prim.type) {
+        case RenderPrimitive::Type::Sphere:
+            return intersect_sphere_packet(prim, p, t_min, prim_index);
+        case RenderPrimitive::Type::Quad:
+            return intersect_quad_packet(prim, p, t_min, prim_index);
+        default:
+            return false;
+        }
+    }, stats.node_visits);
+}
+
+// == packet intersect prims ==
+// lane-wise copies of the scalar tests in raytracer.cpp, keep them in step
+
+bool Raytracer::intersect_sphere_packet(const RenderPrimitive& prim, RayPacket& packet, float t_min, uint32_t item) const
+{
+    const Vec3x4 origin(packet.origin_x, packet.origin_y, packet.origin_z);
+    const Vec3x4 direction(packet.dir_x, packet.dir_y, packet.dir_z);
+    const Float4 t_min4(t_min);
+
+    Vec3x4 oc = origin - Vec3x4(prim.centre);
+    Float4 a = Vec3x4::dot(direction, direction);
+    Float4 half_b = Vec3x4::dot(oc, direction);
+    Float4 c = Vec3x4::dot(oc, oc) - Float4(prim.radius * prim.radius);
+    Float4 discriminant = half_b * half_b - a * c;
+
+    Float4 mask = packet.active & (discriminant >= Float4(0.0f));
+    if (none(mask)) return false;
+
+    Float4 sqrtd = vsqrt(vmax(discriminant, Float4(0.0f)));
+    Float4 neg_half_b = Float4(0.0f) - half_b;
+
+    Float4 root_near = (neg_half_b - sqrtd) / a;
+    Float4 root_far = (neg_half_b + sqrtd) / a;
+    Float4 near_ok = (root_near >= t_min4) & (root_near <= packet.t_max);
+    Float4 far_ok = (root_far >= t_min4) & (root_far <= packet.t_max);
+
+    mask = mask & (near_ok | far_ok);
+    if (none(mask)) return false;
+
+    packet.record_hits(mask, select(near_ok, root_near, root_far), item);
+    return true;
+}
+
+bool Raytracer::intersect_quad_packet(const RenderPrimitive& prim, RayPacket& packet, float t_min, uint32_t item) const
+{
+    const Vec3x4 origin(packet.origin_x, packet.origin_y, packet.origin_z);
+    const Vec3x4 direction(packet.dir_x, packet.dir_y, packet.dir_z);
+    const Vec3x4 normal(prim.quad_normal);
+    const Vec3x4 corner(prim.quad_corner);
+
+    Float4 denom = Vec3x4::dot(normal, direction);
+    Float4 mask = packet.active & (vabs(denom) >= Float4(ALMOST_ZERO));
+    if (none(mask)) return false;
+
+    Float4 t = Vec3x4::dot(corner - origin, normal) / denom;
+    mask = mask & (t >= Float4(t_min)) & (t <= packet.t_max);
+    if (none(mask)) return false;
+
+    Vec3x4 hit_vec = (origin + direction * t) - corner;
+
+    Float4 u = Vec3x4::dot(hit_vec, Vec3x4(prim.quad_u)) / Float4(Vec3::dot(prim.quad_u, prim.quad_u));
+    Float4 v = Vec3x4::dot(hit_vec, Vec3x4(prim.quad_v)) / Float4(Vec3::dot(prim.quad_v, prim.quad_v));
+
+    const Float4 zero(0.0f);
+    const Float4 one(1.0f);
+    mask = mask & (u >= zero) & (u <= one) & (v >= zero) & (v <= one);
+    if (none(mask)) return false;
+
+    packet.record_hits(mask, t, item);
+    return true;
+}
+
+bool Raytracer::intersect_triangle_packet(const RenderTriangle& tri, RayPacket& packet, float t_min, uint32_t item) const
+{
+    const RenderMesh& mesh = scene.meshes[tri.mesh_id];
+    const uint32_t* idx = &mesh.indices[tri.tri_index * 3];
+    const Vec3& v0 = mesh.positions[idx[0]];
+
+    // edges are shared by every lane, only work them out once
+    const Vec3x4 edge1(mesh.positions[idx[1]] - v0);
+    const Vec3x4 edge2(mesh.positions[idx[2]] - v0);
+
+    const Vec3x4 origin(packet.origin_x, packet.origin_y, packet.origin_z);
+    const Vec3x4 direction(packet.dir_x, packet.dir_y, packet.dir_z);
+
+    // Moeller-Trumbore
+    Vec3x4 h = Vec3x4::cross(direction, edge2);
+    Float4 a = Vec3x4::dot(edge1, h);
+
+    Float4 mask = packet.active & (vabs(a) >= Float4(ALMOST_ZERO));
+    if (none(mask)) return false;
+
+    Float4 f = Float4(1.0f) / a;
+    Vec3x4 s = origin - Vec3x4(v0);
+    Float4 u = f * Vec3x4::dot(s, h);
+
+    const Float4 zero(0.0f);
+    const Float4 one(1.0f);
+    mask = mask & (u >= zero) & (u <= one);
+    if (none(mask)) return false;
+
+    Vec3x4 q = Vec3x4::cross(s, edge1);
+    Float4 v = f * Vec3x4::dot(direction, q);
+
+    mask = mask & (v >= zero) & ((u + v) <= one);
+    if (none(mask)) return false;
+
+    Float4 t = f * Vec3x4::dot(edge2, q);
+    mask = mask & (t >= Float4(t_min)) & (t <= packet.t_max);
+    if (none(mask)) return false;
+
+    packet.record_hits(mask, t, item);
+    return true;
+}
+
+bool Raytracer::intersect_instance_packet(uint32_t instance_index, RayPacket& packet, float t_min, uint32_t item) const
+{
+    // each lane goes into object space on its own, there's no sharing the transform
+    float ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+    float dx[PACKET_SIZE], dy[PACKET_SIZE], dz[PACKET_SIZE];
+    float t_max[PACKET_SIZE];
+    packet.origin_x.store(ox); packet.origin_y.store(oy); packet.origin_z.store(oz);
+    packet.dir_x.store(dx); packet.dir_y.store(dy); packet.dir_z.store(dz);
+    packet.t_max.store(t_max);
+    const int active = movemask(packet.active);
+
+    bool hit_any = false;
+    for (int i = 0; i < PACKET_SIZE; ++i) {
+        if (!(active & (1 << i))) continue;
+
+        Intersection rec;
+        Ray ray(Vec3(ox[i], oy[i], oz[i]), Vec3(dx[i], dy[i], dz[i]));
+        if (intersect_instance(instance_index, ray, t_min, t_max[i], rec)) {
+            t_max[i] = rec.t;
+            packet.hit_item[i] = item;
+            hit_any = true;
+        }
+    }
+
+    packet.t_max = Float4::load(t_max);
+    return hit_any;
+}
+
+// == wide leaf ==
+// one ray against 4 tris at once, then rec is filled in from the closest lane
+
+bool Raytracer::intersect_triangle_block(const TriangleBlock4& block, uint32_t mesh_id, const Ray& ray, float t_min, float t_max, Intersection& rec) const
+{
+    const Vec3x4 origin(ray.origin);
+    const Vec3x4 direction(ray.direction);
+    const Vec3x4 v0(block.v0_x, block.v0_y, block.v0_z);
+    const Vec3x4 edge1(block.edge1_x, block.edge1_y, block.edge1_z);
+    const Vec3x4 edge2(block.edge2_x, block.edge2_y, block.edge2_z);
+
+    // Moeller-Trumbore
+    Vec3x4 h = Vec3x4::cross(direction, edge2);
+    Float4 a = Vec3x4::dot(edge1, h);
+
+    Float4 mask = vabs(a) >= Float4(ALMOST_ZERO);
+    if (none(mask)) return false;
+
+    Float4 f = Float4(1.0f) / a;
+    Vec3x4 s = origin - v0;
+    Float4 u = f * Vec3x4::dot(s, h);
+
+    const Float4 zero(0.0f);
+    const Float4 one(1.0f);
+    mask = mask & (u >= zero) & (u <= one);
+    if (none(mask)) return false;
+
+    Vec3x4 q = Vec3x4::cross(s, edge1);
+    Float4 v = f * Vec3x4::dot(direction, q);
+
+    mask = mask & (v >= zero) & ((u + v) <= one);
+    if (none(mask)) return false;
+
+    Float4 t = f * Vec3x4::dot(edge2, q);
+    mask = mask & (t >= Float4(t_min)) & (t <= Float4(t_max));
+    if (none(mask)) return false;
+
+    float nearest_t = hmin(t, mask);
+    int bits = movemask(mask & (t <= Float4(nearest_t)));
+    int lane = 0;
+    while (!(bits & (1 << lane))) ++lane;
+
+    float lane_u[4], lane_v[4];
+    u.store(lane_u);
+    v.store(lane_v);
+
+    if (mesh_id != NO_HIT) {
+        // an instance's, which fills in prim_id itself
+        set_triangle_hit(RenderTriangle{ mesh_id, block.triangle[lane] }, ray, nearest_t, lane_u[lane], lane_v[lane], rec);
+        return true;
+    }
+
+    set_triangle_hit(scene.triangles[block.triangle[lane]], ray, nearest_t, lane_u[lane], lane_v[lane], rec);
+    rec.prim_id = uint32_t(scene.primitives.size()) + block.triangle[lane];
+    return true;
+}
+
+} // namespace okaytracer
+} // namespace ollygon
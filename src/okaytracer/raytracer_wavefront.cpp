@@ -0,0 +1,133 @@
+#define NOMINMAX
+
+// wavefront (ray-stream) version of the CPU integrator.  rather than tracing
+// each pixel's path start to finish, a whole tile's worth of paths advance one
+// bounce at a time: generate -> intersect all -> bucket by material -> shade all.
+// uses the same shade_hit/shade_miss as the megakernel path and each path owns
+// its sampler, so the output matches RenderBackend::CPU exactly
+
+#include "raytracer.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace ollygon {
+namespace okaytracer {
+
+namespace {
+
+// bucket key for paths that missed everything
+constexpr int MISS_BUCKET = int(MaterialType::MaterialTypeCount);
+constexpr int NUM_BUCKETS = MISS_BUCKET + 1;
+
+// per-thread queues, kept around between tiles so we're not reallocating each time
+struct WavefrontQueues {
+    std::vector<PathState> paths;
+    std::vector<int> pixel_indices;
+
+    std::vector<uint32_t> active;        // indices into paths still bouncing
+    std::vector<Ray> rays;               // contiguous copy of active rays for the intersect stage
+    std::vector<Intersection> hits;      // parallel to rays
+    std::vector<int> bucket_keys;        // parallel to rays
+    std::vector<uint32_t> shade_order;   // positions in rays, sorted by bucket
+};
+
+thread_local WavefrontQueues queues;
+
+} // namespace
+
+void Raytracer::render_tile_wavefront(int start_x, int end_x, int start_y, int end_y, const CameraBasis& basis) {
+    WavefrontQueues& q = queues;
+    q.paths.clear();
+    q.pixel_indices.clear();
+    q.active.clear();
+
+    // == generate ==
+    for (int y = start_y; y < end_y; ++y) {
+        for (int x = start_x; x < end_x; ++x) {
+            // same sequence as render_tile
+            Sampler sampler = make_sampler(x, y);
+
+            float px = float(x) + sampler.get(CameraDimension::PixelX);
+            float py = float(y) + sampler.get(CameraDimension::PixelY);
+
+            Vec3 pixel_centre = basis.viewport_upper_left
+                + basis.pixel_delta_u * px
+                - basis.pixel_delta_v * py;
+
+            Vec3 ray_dir = (pixel_centre - basis.camera_pos).normalised();
+
+            q.paths.emplace_back(Ray(basis.camera_pos, ray_dir), config.max_bounces, sampler);
+            q.pixel_indices.push_back(y * config.width + x);
+
+            if (q.paths.back().active) {
+                q.active.push_back(uint32_t(q.paths.size() - 1));
+            }
+        }
+    }
+
+    while (!q.active.empty()) {
+        const size_t count = q.active.size();
+
+        // == intersect ==
+        q.rays.resize(count);
+        q.hits.resize(count);
+        q.bucket_keys.resize(count);
+
+        for (size_t i = 0; i < count; ++i) {
+            q.rays[i] = q.paths[q.active[i]].ray;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (intersect(q.rays[i], 0.001f, std::numeric_limits<float>::infinity(), q.hits[i])) {
+                q.bucket_keys[i] = int(scene.materials[q.hits[i].material_id].type);
+            }
+            else {
+                q.bucket_keys[i] = MISS_BUCKET;
+            }
+        }
+
+        // == bucket ==
+        // counting sort by material type, stable so paths keep their tile order within a bucket
+        int bucket_start[NUM_BUCKETS + 1] = {};
+        for (size_t i = 0; i < count; ++i) {
+            bucket_start[q.bucket_keys[i] + 1]++;
+        }
+        for (int b = 0; b < NUM_BUCKETS; ++b) {
+            bucket_start[b + 1] += bucket_start[b];
+        }
+
+        q.shade_order.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            q.shade_order[bucket_start[q.bucket_keys[i]]++] = uint32_t(i);
+        }
+
+        // == shade ==
+        // one material type at a time, so the scatter() switch stays coherent
+        for (size_t k = 0; k < count; ++k) {
+            uint32_t i = q.shade_order[k];
+            PathState& path = q.paths[q.active[i]];
+
+            if (q.bucket_keys[i] == MISS_BUCKET) {
+                shade_miss(path);
+            }
+            else {
+                shade_hit(path, q.hits[i]);
+            }
+        }
+
+        // == compact ==
+        q.active.erase(
+            std::remove_if(q.active.begin(), q.active.end(), [&](uint32_t p) { return !q.paths[p].active; }),
+            q.active.end()
+        );
+    }
+
+    // == write out ==
+    for (size_t p = 0; p < q.paths.size(); ++p) {
+        write_sample(q.pixel_indices[p], q.paths[p]);
+    }
+}
+
+} // namespace okaytracer
+} // namespace ollygon
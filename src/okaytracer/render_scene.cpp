@@ -1,5 +1,8 @@
 #include "render_scene.hpp"
 #include "core/mat4.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
 
 namespace ollygon {
 namespace okaytracer {
@@ -10,79 +13,352 @@ RenderScene RenderScene::from_scene(const Scene* scene) {
 
     if (!scene) return render_scene;
 
-    add_node_recursive(scene->get_root(), render_scene.primitives);
+    // a geo placed by more than one node is kept once in object space and
+    // instanced, anything else is baked into world space as before
+    BuildContext context;
+    count_geo_users(scene->get_root(), context);
+    render_scene.add_node_recursive(scene->get_root(), context);
 
     return render_scene;
 }
 
-void RenderScene::add_node_recursive(const SceneNode* node, std::vector<RenderPrimitive>& render_prims) {
+uint32_t RenderScene::add_material(const Material& material) {
+    // linear search is fine, this runs once per node and scenes only have a handful of unique mats.
+    // update() compacts away stale ones, so interactive edits can't grow the table without bound
+    for (size_t i = 0; i < materials.size(); ++i) {
+        if (materials[i] == material) return uint32_t(i);
+    }
+    materials.push_back(material);
+    return uint32_t(materials.size() - 1);
+}
+
+void RenderScene::add_mesh(RenderMesh&& mesh) {
+    uint32_t mesh_id = uint32_t(meshes.size());
+    uint32_t tri_count = uint32_t(mesh.tri_count());
+
+    triangles.reserve(triangles.size() + tri_count);
+    for (uint32_t i = 0; i < tri_count; ++i) {
+        triangles.push_back(RenderTriangle{ mesh_id, i });
+    }
+
+    meshes.push_back(std::move(mesh));
+}
+
+void RenderScene::count_geo_users(const SceneNode* node, BuildContext& context) {
+    if (!node || !node->visible) return;
+
+    if (node->node_type == NodeType::Mesh && node->geo && !node->geo->is_empty()) {
+        context.geo_users[node->geo.get()]++;
+    }
+    for (const auto& child : node->children) {
+        count_geo_users(child.get(), context);
+    }
+}
+
+void RenderScene::add_node_recursive(const SceneNode* node, BuildContext& context) {
     
     if (!node || !node->visible) return; //invisible parents = invisible children
 
-    // add primitives
-    if (node->node_type == NodeType::Primitive && node->primitive) {
-        RenderPrimitive render_prim;
+    if (const void* source = render_source(node)) {
+        NodeRecord record;
+        record.node_id = node->id;
+        record.node = node;
+        record.source = source;
+        std::copy(std::begin(node->revisions), std::end(node->revisions), record.revisions);
+
+        const uint32_t material_id = add_node_material(node);
+
+        if (node->node_type == NodeType::Mesh) {
+            const Geo* geo = node->geo.get();
+
+            if (context.geo_users[geo] > 1) {
+                auto shared = context.shared_meshes.find(geo);
+                if (shared == context.shared_meshes.end()) {
+                    shared = context.shared_meshes.emplace(geo, uint32_t(meshes.size())).first;
+                    meshes.push_back(create_object_mesh(geo));
+                }
+
+                RenderInstance instance;
+                instance.mesh_id = shared->second;
+                instance.material_id = material_id;
+                instance.object_to_world = node->transform.to_matrix();
+                instance.world_to_object = instance.object_to_world.inverse();
+
+                record.kind = NodeRecord::Kind::Instance;
+                record.index = uint32_t(instances.size());
+                instances.push_back(instance);
+            }
+            else {
+                record.kind = NodeRecord::Kind::Mesh;
+                record.index = uint32_t(meshes.size());
+                add_mesh(create_mesh(node, geo, material_id));
+            }
+        }
+        else {
+            // prims, and lights with geo
+            switch (node->primitive->get_type()) {
+            case PrimitiveType::Sphere:
+                record.kind = NodeRecord::Kind::Primitive;
+                record.index = uint32_t(primitives.size());
+                primitives.push_back(create_sphere_primitive(
+                    node,
+                    static_cast<const SpherePrimitive*>(node->primitive.get()),
+                    material_id
+                ));
+                break;
+            case PrimitiveType::Quad:
+                record.kind = NodeRecord::Kind::Primitive;
+                record.index = uint32_t(primitives.size());
+                primitives.push_back(create_quad_primitive(
+                    node,
+                    static_cast<const QuadPrimitive*>(node->primitive.get()),
+                    material_id
+                ));
+                break;
+            default: // cuboid, render_source() lets nothing else through
+                record.kind = NodeRecord::Kind::Mesh;
+                record.index = uint32_t(meshes.size());
+                add_mesh(create_cuboid_mesh(
+                    node,
+                    static_cast<const CuboidPrimitive*>(node->primitive.get()),
+                    material_id
+                ));
+                break;
+            }
+        }
+
+        node_records.push_back(record);
+    }
+
+    // recurse children
+    for (const auto& child : node->children) {
+        add_node_recursive(child.get(), context);
+    }
+}
 
-        switch (node->primitive->get_type())
-        {
+const void* RenderScene::render_source(const SceneNode* node) {
+    switch (node->node_type) {
+    case NodeType::Primitive:
+        if (!node->primitive) return nullptr;
+        switch (node->primitive->get_type()) {
         case PrimitiveType::Sphere:
-            render_prim = create_sphere_primitive(
-                node,
-                static_cast<const SpherePrimitive*>(node->primitive.get())
-            );
-            render_prims.push_back(render_prim);
-            break;
         case PrimitiveType::Quad:
-            render_prim = create_quad_primitive(
-                node,
-                static_cast<const QuadPrimitive*>(node->primitive.get())
-            );
-            render_prims.push_back(render_prim);
-            break;
         case PrimitiveType::Cuboid:
-            add_cuboid_as_triangles(
-                node,
-                static_cast<const CuboidPrimitive*>(node->primitive.get()), render_prims
-            );
-            break;
+            return node->primitive.get();
+        default:
+            return nullptr;
+        }
+    case NodeType::Mesh:
+        return node->geo && !node->geo->is_empty() ? node->geo.get() : nullptr;
+    case NodeType::Light:
+        // only area lights have anything to hit
+        return node->primitive && node->primitive->get_type() == PrimitiveType::Quad ? node->primitive.get() : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+uint32_t RenderScene::add_node_material(const SceneNode* node) {
+    // override material with emissive
+    if (node->node_type == NodeType::Light && node->light) {
+        return add_material(Material::emissive(node->light->colour * node->light->intensity));
+    }
+    return add_material(node->material);
+}
+
+void RenderScene::compact_materials() {
+    std::vector<Material> compacted;
+    std::vector<uint32_t> remap(materials.size(), UINT32_MAX);
+    const auto keep = [&](uint32_t& material_id) {
+        if (remap[material_id] == UINT32_MAX) {
+            remap[material_id] = uint32_t(compacted.size());
+            compacted.push_back(materials[material_id]);
         }
+        material_id = remap[material_id];
+    };
+
+    for (RenderPrimitive& prim : primitives) keep(prim.material_id);
+    for (RenderMesh& mesh : meshes) keep(mesh.material_id);
+    for (RenderInstance& instance : instances) keep(instance.material_id);
+    materials = std::move(compacted);
+}
+
+// == incremental update ==
+
+void RenderScene::collect_render_nodes(const SceneNode* node, std::vector<const SceneNode*>& nodes) {
+    if (!node || !node->visible) return;
 
+    if (render_source(node)) nodes.push_back(node);
+    for (const auto& child : node->children) {
+        collect_render_nodes(child.get(), nodes);
     }
+}
+
+RenderSceneChanges RenderScene::update(const Scene* scene) {
+    RenderSceneChanges changes;
 
-    //add meshes
-    if (node->node_type == NodeType::Mesh && node->geo) {
-        add_mesh_primitives(node, node->geo.get(), render_prims);
+    if (!scene) {
+        *this = RenderScene();
+        changes.rebuilt = true;
+        return changes;
     }
+    sky = scene->get_sky();
 
-    // add lights with geo
-    if (node->node_type == NodeType::Light && node->primitive) {
-        RenderPrimitive render_prim;
+    // same nodes with the same geo/prims in the same order, or start again
+    std::vector<const SceneNode*> nodes;
+    collect_render_nodes(scene->get_root(), nodes);
 
-        switch (node->primitive->get_type()) {
-        case PrimitiveType::Quad:
-            render_prim = create_quad_primitive(
-                node,
-                static_cast<const QuadPrimitive*>(node->primitive.get())
-            );
-            // override material with emissive
-            if (node->light) {
-                render_prim.material = Material::emissive(node->light->colour * node->light->intensity);
+    bool same_structure = nodes.size() == node_records.size();
+    for (size_t i = 0; same_structure && i < nodes.size(); ++i) {
+        same_structure = nodes[i]->id == node_records[i].node_id
+            && render_source(nodes[i]) == node_records[i].source;
+    }
+
+    if (!same_structure) {
+        *this = from_scene(scene);
+        changes.rebuilt = true;
+        return changes;
+    }
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        NodeRecord& record = node_records[i];
+        record.node = nodes[i];
+        const SceneNode* node = record.node;
+
+        const auto changed = [&](NodeChange change) {
+            return node->revisions[int(change)] != record.revisions[int(change)];
+        };
+
+        if (changed(NodeChange::Material)) {
+            const uint32_t material_id = add_node_material(node);
+            switch (record.kind) {
+            case NodeRecord::Kind::Primitive: primitives[record.index].material_id = material_id; break;
+            case NodeRecord::Kind::Mesh: meshes[record.index].material_id = material_id; break;
+            case NodeRecord::Kind::Instance: instances[record.index].material_id = material_id; break;
             }
-            render_prims.push_back(render_prim);
-            break;
-        default: break;
+            changes.materials = true;
         }
+
+        if (changed(NodeChange::Transform) || changed(NodeChange::Geometry)) {
+            if (!update_shape(record, changed(NodeChange::Geometry), changes)) {
+                *this = from_scene(scene);
+                changes = RenderSceneChanges();
+                changes.rebuilt = true;
+                return changes;
+            }
+            changes.geometry = true;
+        }
+
+        std::copy(std::begin(node->revisions), std::end(node->revisions), record.revisions);
     }
 
-    // recurse children
-    for (const auto& child : node->children) {
-        add_node_recursive(child.get(), render_prims);
+    // every node has one material, so past twice as many entries most are stale.
+    // amortised over the edits that made them, and ids only change with materials set
+    if (changes.materials && materials.size() > 2 * node_records.size()) {
+        compact_materials();
+    }
+
+    return changes;
+}
+
+bool RenderScene::update_shape(const NodeRecord& record, bool geometry_changed, RenderSceneChanges& changes) {
+    const SceneNode* node = record.node;
+
+    switch (record.kind) {
+    case NodeRecord::Kind::Primitive: {
+        RenderPrimitive& prim = primitives[record.index];
+        prim = prim.type == RenderPrimitive::Type::Sphere
+            ? create_sphere_primitive(node, static_cast<const SpherePrimitive*>(node->primitive.get()), prim.material_id)
+            : create_quad_primitive(node, static_cast<const QuadPrimitive*>(node->primitive.get()), prim.material_id);
+        changes.moved_primitives.push_back(record.index);
+        return true;
+    }
+    case NodeRecord::Kind::Mesh: {
+        RenderMesh& mesh = meshes[record.index];
+        RenderMesh updated = node->node_type == NodeType::Mesh
+            ? create_mesh(node, node->geo.get(), mesh.material_id)
+            : create_cuboid_mesh(node, static_cast<const CuboidPrimitive*>(node->primitive.get()), mesh.material_id);
+        // triangles holds one entry per tri, a different count would shift them all
+        if (updated.tri_count() != mesh.tri_count()) return false;
+        mesh = std::move(updated);
+        changes.moved_meshes.push_back(record.index);
+        return true;
+    }
+    case NodeRecord::Kind::Instance: {
+        RenderInstance& instance = instances[record.index];
+        instance.object_to_world = node->transform.to_matrix();
+        instance.world_to_object = instance.object_to_world.inverse();
+        if (geometry_changed) {
+            // shared, so every placement picks the edit up
+            RenderMesh& mesh = meshes[instance.mesh_id];
+            RenderMesh updated = create_object_mesh(node->geo.get());
+            if (updated.tri_count() != mesh.tri_count()) return false;
+            mesh = std::move(updated);
+            changes.moved_meshes.push_back(instance.mesh_id);
+        }
+        changes.moved_instances.push_back(record.index);
+        return true;
     }
+    }
+    return false;
+}
+
+// == bounds ==
+
+Aabb RenderPrimitive::bounds() const
+{
+    Aabb box;
+
+    switch (type) {
+    case Type::Sphere: {
+        float r = std::abs(radius);
+        box.expand(centre - Vec3(r));
+        box.expand(centre + Vec3(r));
+        break;
+    }
+    case Type::Quad:
+        box.expand(quad_corner);
+        box.expand(quad_corner + quad_u);
+        box.expand(quad_corner + quad_v);
+        box.expand(quad_corner + quad_u + quad_v);
+        break;
+    default: break;
+    }
+
+    return box;
+}
+
+Aabb RenderScene::triangle_bounds(const RenderTriangle& tri) const
+{
+    const RenderMesh& mesh = meshes[tri.mesh_id];
+    const uint32_t* idx = &mesh.indices[tri.tri_index * 3];
+
+    Aabb box;
+    box.expand(mesh.positions[idx[0]]);
+    box.expand(mesh.positions[idx[1]]);
+    box.expand(mesh.positions[idx[2]]);
+    return box;
+}
+
+RenderMesh RenderScene::bake_instance(const RenderInstance& instance) const
+{
+    const RenderMesh& object = meshes[instance.mesh_id];
+
+    RenderMesh mesh;
+    mesh.material_id = instance.material_id;
+    mesh.indices = object.indices;
+    mesh.positions.reserve(object.positions.size());
+    mesh.normals.reserve(object.normals.size());
+    for (size_t i = 0; i < object.positions.size(); ++i) {
+        mesh.positions.push_back(instance.object_to_world.transform_point(object.positions[i]));
+        mesh.normals.push_back(instance.object_to_world.transform_direction(object.normals[i]).normalised());
+    }
+    return mesh;
 }
 
 // == create prims ==
 
-RenderPrimitive RenderScene::create_sphere_primitive(const SceneNode* node, const SpherePrimitive* sphere)
+RenderPrimitive RenderScene::create_sphere_primitive(const SceneNode* node, const SpherePrimitive* sphere, uint32_t material_id)
 {
     RenderPrimitive prim;
     prim.type = RenderPrimitive::Type::Sphere;
@@ -92,12 +368,12 @@ RenderPrimitive RenderScene::create_sphere_primitive(const SceneNode* node, cons
     prim.radius = sphere->radius * node->transform.scale.x; //TEMP uniform on x
     // no rotation yet..until spheroids
 
-    prim.material = node->material;
+    prim.material_id = material_id;
 
     return prim;
 }
 
-RenderPrimitive RenderScene::create_quad_primitive(const SceneNode* node, const QuadPrimitive* quad)
+RenderPrimitive RenderScene::create_quad_primitive(const SceneNode* node, const QuadPrimitive* quad, uint32_t material_id)
 {
     RenderPrimitive prim;
     prim.type = RenderPrimitive::Type::Quad;
@@ -110,12 +386,12 @@ RenderPrimitive RenderScene::create_quad_primitive(const SceneNode* node, const
     prim.quad_v = model.transform_direction(quad->v * 2.0f);
     prim.quad_normal = Vec3::cross(prim.quad_u, prim.quad_v).normalised();
 
-    prim.material = node->material;
+    prim.material_id = material_id;
 
     return prim;
 }
 
-void RenderScene::add_cuboid_as_triangles(const SceneNode* node, const CuboidPrimitive* cuboid, std::vector<RenderPrimitive>& prims)
+RenderMesh RenderScene::create_cuboid_mesh(const SceneNode* node, const CuboidPrimitive* cuboid, uint32_t material_id)
 {
     Mat4 model = node->transform.to_matrix();
 
@@ -153,72 +429,64 @@ void RenderScene::add_cuboid_as_triangles(const SceneNode* node, const CuboidPri
         {{7, 6, 2, 3}, Vec3(0,  1, 0)}   // top
     };
 
-    // create 2 tris per face
+    // 4 verts per face so each face keeps its flat normal
+    RenderMesh mesh;
+    mesh.material_id = material_id;
+    mesh.positions.reserve(24);
+    mesh.normals.reserve(24);
+    mesh.indices.reserve(36);
+
     for (int f = 0; f < 6; ++f) {
         // transform the normal
         Vec3 world_normal = model.transform_direction(faces[f].normal).normalised();
 
-        // first tri (0, 1, 2)
-        RenderPrimitive tri1;
-        tri1.type = RenderPrimitive::Type::Triangle;
-        tri1.tri_v0 = world_corners[faces[f].indices[0]];
-        tri1.tri_v1 = world_corners[faces[f].indices[1]];
-        tri1.tri_v2 = world_corners[faces[f].indices[2]];
-        tri1.tri_n0 = world_normal;
-        tri1.tri_n1 = world_normal;
-        tri1.tri_n2 = world_normal;
-        tri1.material = node->material;
-        prims.push_back(tri1);
-
-        // second (0, 2, 3)
-        RenderPrimitive tri2;
-        tri2.type = RenderPrimitive::Type::Triangle;
-        tri2.tri_v0 = world_corners[faces[f].indices[0]];
-        tri2.tri_v1 = world_corners[faces[f].indices[2]];
-        tri2.tri_v2 = world_corners[faces[f].indices[3]];
-        tri2.tri_n0 = world_normal;
-        tri2.tri_n1 = world_normal;
-        tri2.tri_n2 = world_normal;
-        tri2.material = node->material;
-        prims.push_back(tri2);
+        uint32_t base = uint32_t(mesh.positions.size());
+        for (int c = 0; c < 4; ++c) {
+            mesh.positions.push_back(world_corners[faces[f].indices[c]]);
+            mesh.normals.push_back(world_normal);
+        }
+
+        // 2 tris per face, (0, 1, 2) and (0, 2, 3)
+        mesh.indices.insert(mesh.indices.end(), { base, base + 1, base + 2 });
+        mesh.indices.insert(mesh.indices.end(), { base, base + 2, base + 3 });
     }
+
+    return mesh;
 }
 
 // == create mesh ==
 
-void RenderScene::add_mesh_primitives(const SceneNode* node, const Geo* geo, std::vector<RenderPrimitive>& prims)
+RenderMesh RenderScene::create_mesh(const SceneNode* node, const Geo* geo, uint32_t material_id)
 {
-    if (geo->indices.empty() || geo->verts.empty()) return;
-
     Mat4 model = node->transform.to_matrix();
 
-    // convert each tri to world space
-    for (size_t i = 0; i < geo->indices.size(); i += 3) {
-        uint32_t i0 = geo->indices[i];
-        uint32_t i1 = geo->indices[i + 1];
-        uint32_t i2 = geo->indices[i + 2];
-
-        const Vertex& v0 = geo->verts[i0];
-        const Vertex& v1 = geo->verts[i1];
-        const Vertex& v2 = geo->verts[i2];
-
-        RenderPrimitive prim;
-        prim.type = RenderPrimitive::Type::Triangle;
-
-        // transform verts to world space
-        prim.tri_v0 = model.transform_point(v0.position);
-        prim.tri_v1 = model.transform_point(v1.position);
-        prim.tri_v2 = model.transform_point(v2.position);
+    RenderMesh mesh;
+    mesh.material_id = material_id;
+    mesh.indices = geo->indices;
 
+    // verts to world space once each, rather than once per tri that touches them
+    mesh.positions.reserve(geo->verts.size());
+    mesh.normals.reserve(geo->verts.size());
+    for (const Vertex& v : geo->verts) {
+        mesh.positions.push_back(model.transform_point(v.position));
         // transform normals..use normal matrix
-        prim.tri_n0 = model.transform_direction(v0.normal).normalised();
-        prim.tri_n1 = model.transform_direction(v1.normal).normalised();
-        prim.tri_n2 = model.transform_direction(v2.normal).normalised();
+        mesh.normals.push_back(model.transform_direction(v.normal).normalised());
+    }
 
-        prim.material = node->material;
+    return mesh;
+}
 
-        prims.push_back(prim);
+RenderMesh RenderScene::create_object_mesh(const Geo* geo)
+{
+    RenderMesh mesh;
+    mesh.indices = geo->indices;
+    mesh.positions.reserve(geo->verts.size());
+    mesh.normals.reserve(geo->verts.size());
+    for (const Vertex& v : geo->verts) {
+        mesh.positions.push_back(v.position);
+        mesh.normals.push_back(v.normal);
     }
+    return mesh;
 }
 
 } // namespace okaytracer
@@ -5,17 +5,18 @@
 #include "../core/scene.hpp"
 #include "../core/material.hpp"
 #include "../core/sky.hpp"
+#include "aabb.hpp"
 #include <vector>
+#include <unordered_map>
 
 namespace ollygon {
 namespace okaytracer {
 
-// flattened primitive for raytracing
+// flattened analytic primitive for raytracing. triangles live in RenderMesh
 struct RenderPrimitive {
     enum class Type {
         Sphere,
         Quad,
-        Triangle,
         Cuboid // even if we handle this by quads/tris in our renderers, might be useful to optimise for and keep here
     };
 
@@ -31,51 +32,147 @@ struct RenderPrimitive {
     Vec3 quad_v;
     Vec3 quad_normal;
 
-    //tri data (world space)
-    Vec3 tri_v0, tri_v1, tri_v2;
-    Vec3 tri_n0, tri_n1, tri_n2;
+    // index into RenderScene::materials, shared between all prims using it
+    uint32_t material_id;
 
-    // material
-    Material material;
+    RenderPrimitive() : type(Type::Sphere), radius(1.0f), material_id(0) {}
 
-    RenderPrimitive() : type(Type::Sphere), radius(1.0f) {}
+    Aabb bounds() const;
+};
+
+// indexed triangle mesh in world space, or object space if it's placed through
+// RenderInstances.  verts are shared between the tris that use them, same as
+// Geo, rather than being copied out per tri
+struct RenderMesh {
+    std::vector<Vec3> positions;
+    std::vector<Vec3> normals;     // per vertex, parallel to positions
+    std::vector<uint32_t> indices; // triplets for tris
+    uint32_t material_id;
+
+    RenderMesh() : material_id(0) {}
+
+    size_t tri_count() const { return indices.size() / 3; }
+};
+
+// 8 byte handle to one tri of one mesh, this is what the accel structure holds
+struct RenderTriangle {
+    uint32_t mesh_id;
+    uint32_t tri_index;
+};
+
+// one placement of a mesh that several nodes share.  the mesh stays in object
+// space and rays are moved into it instead, so N copies cost one mesh and one bvh
+struct RenderInstance {
+    uint32_t mesh_id;
+    uint32_t material_id; // per placement, the mesh's own is unused
+    Mat4 object_to_world;
+    Mat4 world_to_object;
+};
+
+// what RenderScene::update() had to redo, so the raytracer knows what's stale
+struct RenderSceneChanges {
+    bool rebuilt = false;   // converted from scratch, nothing carried over
+    bool materials = false; // some material ids changed, and with them maybe the lights
+    bool geometry = false;  // something moved or changed shape, the acceleration is stale
+
+    // what moved or changed shape in place, so the acceleration can be refit
+    // rather than rebuilt.  tri counts never change here, that's a rebuild
+    std::vector<uint32_t> moved_primitives;
+    std::vector<uint32_t> moved_meshes;    // world space ones, or object space ones whose geo changed
+    std::vector<uint32_t> moved_instances; // transformed, a reshaped mesh moves its instances by itself
+
+    bool any() const { return rebuilt || materials || geometry; }
 };
 
 // flattened scene optimised for raytracing
 class RenderScene {
 public:
     std::vector<RenderPrimitive> primitives;
+    std::vector<RenderMesh> meshes;
+    std::vector<RenderTriangle> triangles; // every tri of every world space mesh
+    std::vector<RenderInstance> instances; // placements of the object space ones
+    std::vector<Material> materials; // deduplicated, indexed by material_id
 
     static RenderScene from_scene(const Scene* scene); //convert
 
+    // brings a scene converted by from_scene() up to date with edits since,
+    // redoing only the nodes marked dirty.  falls back to a full conversion if
+    // nodes were added, removed, hidden or given a different geo/primitive, or
+    // a geometry edit changed a mesh's tri count.  edited materials leave their
+    // old entries behind, the table is compacted once those outnumber the live ones
+    RenderSceneChanges update(const Scene* scene);
+
+    // returns the id of an identical existing material, or appends it
+    uint32_t add_material(const Material& material);
+
+    Aabb triangle_bounds(const RenderTriangle& tri) const;
+
+    // world space copy of an instance, for backends that can't instance
+    RenderMesh bake_instance(const RenderInstance& instance) const;
+
     Sky sky;
 
 private:
-    static void add_node_recursive(
-        const SceneNode* node,
-        std::vector<RenderPrimitive>& render_prims
-    );
+    // what a visible node turned into, in conversion order, so update() can find it again
+    struct NodeRecord {
+        enum class Kind { Primitive, Mesh, Instance };
+
+        uint64_t node_id;
+        const SceneNode* node;
+        const void* source; // the geo or primitive converted
+        Kind kind;
+        uint32_t index;     // into primitives, meshes or instances, by kind
+        uint32_t revisions[int(NodeChange::NodeChangeCount)]; // the node's, as converted
+    };
+    std::vector<NodeRecord> node_records;
+
+    struct BuildContext {
+        std::unordered_map<const Geo*, int> geo_users; // visible mesh nodes per geo
+        std::unordered_map<const Geo*, uint32_t> shared_meshes; // object space, into meshes
+    };
+
+    static void count_geo_users(const SceneNode* node, BuildContext& context);
+    void add_node_recursive(const SceneNode* node, BuildContext& context);
+
+    // the node's geo or primitive if it converts to anything, else null
+    static const void* render_source(const SceneNode* node);
+    // visible nodes that convert to something, in the order add_node_recursive() meets them
+    static void collect_render_nodes(const SceneNode* node, std::vector<const SceneNode*>& nodes);
+    // lights override the node's material with their own emission
+    uint32_t add_node_material(const SceneNode* node);
+    // drops materials nothing refers to any more and renumbers the rest
+    void compact_materials();
+    // redoes a record's prim/mesh/instance from its node, keeping the material.
+    // false if the tri count changed, which update() can't patch in place
+    bool update_shape(const NodeRecord& record, bool geometry_changed, RenderSceneChanges& changes);
+
+    // appends mesh and registers all of its tris
+    void add_mesh(RenderMesh&& mesh);
 
     static RenderPrimitive create_sphere_primitive(
         const SceneNode* node,
-        const SpherePrimitive* sphere
+        const SpherePrimitive* sphere,
+        uint32_t material_id
     );
     static RenderPrimitive create_quad_primitive(
         const SceneNode* node,
-        const QuadPrimitive* quad
+        const QuadPrimitive* quad,
+        uint32_t material_id
     );
     // cuboids are converted to tris
-    static void add_cuboid_as_triangles(
+    static RenderMesh create_cuboid_mesh(
         const SceneNode* node,
         const CuboidPrimitive* cuboid,
-        std::vector<RenderPrimitive>& prims
+        uint32_t material_id
     );
 
-    static void add_mesh_primitives(
+    static RenderMesh create_mesh(
         const SceneNode* node,
         const Geo* geo,
-        std::vector<RenderPrimitive>& prims
+        uint32_t material_id
     );
+    // untransformed, for instancing
+    static RenderMesh create_object_mesh(const Geo* geo);
 
 
 };
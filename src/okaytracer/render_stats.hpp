@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace ollygon {
+namespace okaytracer {
+
+// where the CPU backends' time went.  each pool thread counts into its own
+// copy, they're summed once a pass, so counting is a plain increment.
+// aligned so neighbouring threads' copies don't share a cache line
+struct alignas(64) RenderStats {
+    static constexpr int BOUNCE_BINS = 16; // paths that hit more surfaces than this share the last bin
+
+    uint64_t rays = 0;             // camera, bounce and shadow rays.  a packet counts its live lanes
+    uint64_t primitive_tests = 0;  // ray against prim or tri, a SIMD block counts its tris
+    uint64_t node_visits = 0;      // bvh nodes (leaves included) a ray or packet went into
+    uint64_t roulette_kills = 0;   // paths ended by russian roulette
+    uint64_t paths = 0;            // camera samples, ie pixels times passes
+    std::array<uint64_t, BOUNCE_BINS> bounce_histogram = {}; // paths by surfaces hit before ending
+    double wall_ms = 0.0;          // for the pass, or summed over passes in totals
+
+    void merge(const RenderStats& other) {
+        rays += other.rays;
+        primitive_tests += other.primitive_tests;
+        node_visits += other.node_visits;
+        roulette_kills += other.roulette_kills;
+        paths += other.paths;
+        for (int i = 0; i < BOUNCE_BINS; ++i) {
+            bounce_histogram[i] += other.bounce_histogram[i];
+        }
+        wall_ms += other.wall_ms;
+    }
+
+    void add_path(int bounces) {
+        paths++;
+        bounce_histogram[bounces < BOUNCE_BINS ? bounces : BOUNCE_BINS - 1]++;
+    }
+
+    double mrays_per_second() const { return wall_ms > 0.0 ? double(rays) / (wall_ms * 1000.0) : 0.0; }
+};
+
+} // namespace okaytracer
+} // namespace ollygon
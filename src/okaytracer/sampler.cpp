@@ -0,0 +1,54 @@
+#define NOMINMAX
+
+#include "sampler.hpp"
+
+namespace ollygon {
+namespace okaytracer {
+
+namespace {
+
+using DirectionTable = std::array<std::array<uint32_t, 4>, 32>;
+
+// direction numbers from joe & kuo's primitive polynomials and initial m values,
+// the first dimension is van der corput
+constexpr DirectionTable make_directions() {
+    struct Poly { int degree; uint32_t a; uint32_t m[3]; };
+    constexpr Poly polys[3] = {
+        { 1, 0, { 1, 0, 0 } },
+        { 2, 1, { 1, 3, 0 } },
+        { 3, 1, { 1, 3, 1 } },
+    };
+
+    DirectionTable directions = {};
+    for (int i = 0; i < 32; ++i) {
+        directions[i][0] = 1u << (31 - i);
+    }
+
+    for (int d = 0; d < 3; ++d) {
+        const Poly& p = polys[d];
+        uint32_t m[32] = {};
+        for (int k = 0; k < 32; ++k) {
+            if (k < p.degree) {
+                m[k] = p.m[k];
+                continue;
+            }
+            m[k] = m[k - p.degree] ^ (m[k - p.degree] << p.degree);
+            for (int j = 1; j < p.degree; ++j) {
+                if ((p.a >> (p.degree - 1 - j)) & 1) {
+                    m[k] ^= m[k - j] << j;
+                }
+            }
+        }
+        for (int k = 0; k < 32; ++k) {
+            directions[k][d + 1] = m[k] << (31 - k);
+        }
+    }
+    return directions;
+}
+
+} // namespace
+
+const DirectionTable Sampler::SOBOL_DIRECTIONS = make_directions();
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <algorithm>
+
+namespace ollygon {
+namespace okaytracer {
+
+enum class SamplerType {
+    Random, // independent xorshift stream per pixel and pass, white noise
+    Sobol   // owen scrambled sobol, stratified across a pixel's samples
+};
+
+// which decision a sample value is for.  each gets a fixed dimension so that with
+// a low discrepancy sampler, say, the bsdf direction at bounce 2 is stratified over
+// all of a pixel's samples no matter what else the paths did.  grouped in fours
+// since that's how far the sobol sequence is kept (the rest is padded, see Sampler)
+enum class CameraDimension {
+    PixelX, PixelY
+};
+
+enum class BounceDimension {
+    BsdfU, BsdfV, BsdfChoice, RussianRoulette,
+    LightU, LightV, LightPick
+};
+
+class Sampler {
+public:
+    static constexpr uint32_t BOUNCE_BASE = 4;   // camera dimensions, padded out to a group
+    static constexpr uint32_t BOUNCE_STRIDE = 8; // per bounce, ditto
+
+    Sampler() : type(SamplerType::Random), pixel_seed(0), sample_index(0), bounce_base(0), cached_group(NO_GROUP), rng(1) {}
+
+    // pixel_seed should be the same every pass, rng different every pass
+    Sampler(SamplerType _type, uint32_t _pixel_seed, uint32_t _sample_index, uint64_t _rng)
+        : type(_type)
+        , pixel_seed(_pixel_seed)
+        , sample_index(_sample_index)
+        , bounce_base(BOUNCE_BASE)
+        , cached_group(NO_GROUP)
+        , rng(_rng)
+    {}
+
+    // camera dimensions before, per bounce ones after
+    void start_bounce(int bounce) { bounce_base = BOUNCE_BASE + uint32_t(bounce) * BOUNCE_STRIDE; }
+
+    float get(CameraDimension dim) { return get(uint32_t(dim)); }
+    float get(BounceDimension dim) { return get(bounce_base + uint32_t(dim)); }
+
+    // in [0, 1)
+    float get(uint32_t dimension) {
+        if (type == SamplerType::Random) {
+            // from https://en.wikipedia.org/wiki/Xorshift, plain stream so dimension is ignored
+            rng ^= rng >> 12;
+            rng ^= rng << 25;
+            rng ^= rng >> 27;
+            return float((rng * 0x2545F4914F6CDD1DULL) >> 33) / float(1ULL << 31);
+        }
+        // a group's dimensions are always wanted together, and all 4 cost about the same as 1
+        const uint32_t group = dimension / 4;
+        if (group != cached_group) {
+            sobol_owen(group);
+        }
+        return cached[dimension % 4];
+    }
+
+private:
+    // burley 2020, "practical hash-based owen scrambling".  sobol proper only goes to 4
+    // dimensions, past that each group of 4 is a separately shuffled copy (padding),
+    // so groups are stratified within themselves but not against each other
+    void sobol_owen(uint32_t group) {
+        const uint32_t group_seed = hash_combine(pixel_seed, group);
+        const uint32_t index = nested_uniform_scramble(sample_index, group_seed);
+
+        // index is scrambled so its bits are coin flips, masking beats branching on them
+        uint32_t x[4] = { 0, 0, 0, 0 };
+        for (int bit = 0; bit < 32; ++bit) {
+            const uint32_t mask = 0u - ((index >> bit) & 1);
+            for (int c = 0; c < 4; ++c) {
+                x[c] ^= SOBOL_DIRECTIONS[bit][c] & mask;
+            }
+        }
+
+        for (uint32_t c = 0; c < 4; ++c) {
+            const uint32_t scrambled = nested_uniform_scramble(x[c], hash_combine(group_seed, c + 1));
+            // 0x1p-32, clamped so rounding can't land on 1
+            cached[c] = std::min(float(scrambled) * 2.3283064365386963e-10f, 0.99999994f);
+        }
+        cached_group = group;
+    }
+
+    static uint32_t reverse_bits(uint32_t x) {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    // hash whose output bits only depend on input bits below them, ie an owen
+    // scramble of the reversed bits
+    static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+
+    static uint32_t hash_combine(uint32_t seed, uint32_t v) {
+        return seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+    }
+
+    // direction numbers for the first 4 dimensions, indexed [bit][dimension] so
+    // one bit's are together.  see sampler.cpp
+    static const std::array<std::array<uint32_t, 4>, 32> SOBOL_DIRECTIONS;
+
+    SamplerType type;
+    uint32_t pixel_seed;
+    uint32_t sample_index;
+    uint32_t bounce_base; // dimension of this bounce's BounceDimension::BsdfU
+
+    static constexpr uint32_t NO_GROUP = 0xFFFFFFFFu;
+    uint32_t cached_group;
+    float cached[4];
+
+    uint64_t rng;
+};
+
+} // namespace okaytracer
+} // namespace ollygon
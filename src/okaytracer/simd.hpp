@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+// minimal 4-wide float for the CPU tracer's SIMD paths.  SSE whenever the
+// compiler guarantees it (every x64 build), plain arrays otherwise so the
+// same code still builds and runs elsewhere, just without the speedup
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OLLYGON_SIMD_SSE
+#include <immintrin.h>
+#endif
+
+namespace ollygon {
+namespace okaytracer {
+
+// comparisons return a Float4 with all bits set in passing lanes, which is
+// what the bitwise ops, select() and movemask() expect
+struct Float4 {
+#ifdef OLLYGON_SIMD_SSE
+    __m128 v;
+
+    Float4() : v(_mm_setzero_ps()) {}
+    explicit Float4(__m128 _v) : v(_v) {}
+    explicit Float4(float s) : v(_mm_set1_ps(s)) {}
+    Float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+
+    static Float4 load(const float* p) { return Float4(_mm_loadu_ps(p)); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+
+    float operator[](int i) const {
+        alignas(16) float tmp[4];
+        _mm_store_ps(tmp, v);
+        return tmp[i];
+    }
+#else
+    float v[4];
+
+    Float4() : v{ 0.0f, 0.0f, 0.0f, 0.0f } {}
+    explicit Float4(float s) : v{ s, s, s, s } {}
+    Float4(float a, float b, float c, float d) : v{ a, b, c, d } {}
+
+    static Float4 load(const float* p) { return Float4(p[0], p[1], p[2], p[3]); }
+    void store(float* p) const { for (int i = 0; i < 4; ++i) p[i] = v[i]; }
+
+    float operator[](int i) const { return v[i]; }
+#endif
+};
+
+#ifdef OLLYGON_SIMD_SSE
+
+inline Float4 operator+(const Float4& a, const Float4& b) { return Float4(_mm_add_ps(a.v, b.v)); }
+inline Float4 operator-(const Float4& a, const Float4& b) { return Float4(_mm_sub_ps(a.v, b.v)); }
+inline Float4 operator*(const Float4& a, const Float4& b) { return Float4(_mm_mul_ps(a.v, b.v)); }
+inline Float4 operator/(const Float4& a, const Float4& b) { return Float4(_mm_div_ps(a.v, b.v)); }
+
+inline Float4 operator<(const Float4& a, const Float4& b) { return Float4(_mm_cmplt_ps(a.v, b.v)); }
+inline Float4 operator<=(const Float4& a, const Float4& b) { return Float4(_mm_cmple_ps(a.v, b.v)); }
+inline Float4 operator>(const Float4& a, const Float4& b) { return Float4(_mm_cmpgt_ps(a.v, b.v)); }
+inline Float4 operator>=(const Float4& a, const Float4& b) { return Float4(_mm_cmpge_ps(a.v, b.v)); }
+
+inline Float4 operator&(const Float4& a, const Float4& b) { return Float4(_mm_and_ps(a.v, b.v)); }
+inline Float4 operator|(const Float4& a, const Float4& b) { return Float4(_mm_or_ps(a.v, b.v)); }
+inline Float4 andnot(const Float4& mask, const Float4& a) { return Float4(_mm_andnot_ps(mask.v, a.v)); }
+
+inline Float4 vmin(const Float4& a, const Float4& b) { return Float4(_mm_min_ps(a.v, b.v)); }
+inline Float4 vmax(const Float4& a, const Float4& b) { return Float4(_mm_max_ps(a.v, b.v)); }
+inline Float4 vsqrt(const Float4& a) { return Float4(_mm_sqrt_ps(a.v)); }
+inline Float4 vabs(const Float4& a) { return Float4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+
+// truncated toward zero like int(f), lanes into p[0..3]
+inline void store_int(const Float4& a, int32_t* p) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_cvttps_epi32(a.v)); }
+
+// mask ? a : b, per lane
+inline Float4 select(const Float4& mask, const Float4& a, const Float4& b) {
+    return Float4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+}
+
+// one bit per lane, lane 0 in bit 0
+inline int movemask(const Float4& mask) { return _mm_movemask_ps(mask.v); }
+
+// e^x, to ~1e-7 relative.  x is clamped to [-87, 88] so the result stays a normal float
+inline Float4 vexp(const Float4& x) {
+    __m128 xc = _mm_min_ps(_mm_max_ps(x.v, _mm_set1_ps(-87.0f)), _mm_set1_ps(88.0f));
+
+    // e^x = 2^n * e^r, with n = round(x / ln2) so |r| <= ln2/2
+    __m128i n = _mm_cvtps_epi32(_mm_mul_ps(xc, _mm_set1_ps(1.44269504f)));
+    __m128 fn = _mm_cvtepi32_ps(n);
+    __m128 r = _mm_sub_ps(xc, _mm_mul_ps(fn, _mm_set1_ps(0.693359375f)));
+    r = _mm_sub_ps(r, _mm_mul_ps(fn, _mm_set1_ps(-2.12194440e-4f)));
+
+    // taylor series to r^6, horner form
+    __m128 p = _mm_set1_ps(1.0f / 720.0f);
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.0f / 120.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.0f / 24.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.0f / 6.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(0.5f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.0f));
+
+    // build 2^n straight into the exponent bits
+    __m128 pow2n = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+    return Float4(_mm_mul_ps(p, pow2n));
+}
+
+#else
+
+namespace simd_detail {
+inline float mask_from(bool b) {
+    uint32_t bits = b ? 0xFFFFFFFFu : 0u;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+inline uint32_t bits_of(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+inline float from_bits(uint32_t bits) {
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+} // namespace simd_detail
+
+#define OLLYGON_FLOAT4_LANEWISE(expr) \
+    Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r;
+
+inline Float4 operator+(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(a.v[i] + b.v[i]) }
+inline Float4 operator-(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(a.v[i] - b.v[i]) }
+inline Float4 operator*(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(a.v[i] * b.v[i]) }
+inline Float4 operator/(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(a.v[i] / b.v[i]) }
+
+inline Float4 operator<(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(simd_detail::mask_from(a.v[i] < b.v[i])) }
+inline Float4 operator<=(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(simd_detail::mask_from(a.v[i] <= b.v[i])) }
+inline Float4 operator>(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(simd_detail::mask_from(a.v[i] > b.v[i])) }
+inline Float4 operator>=(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(simd_detail::mask_from(a.v[i] >= b.v[i])) }
+
+inline Float4 operator&(const Float4& a, const Float4& b) {
+    OLLYGON_FLOAT4_LANEWISE(simd_detail::from_bits(simd_detail::bits_of(a.v[i]) & simd_detail::bits_of(b.v[i])))
+}
+inline Float4 operator|(const Float4& a, const Float4& b) {
+    OLLYGON_FLOAT4_LANEWISE(simd_detail::from_bits(simd_detail::bits_of(a.v[i]) | simd_detail::bits_of(b.v[i])))
+}
+inline Float4 andnot(const Float4& mask, const Float4& a) {
+    OLLYGON_FLOAT4_LANEWISE(simd_detail::from_bits(~simd_detail::bits_of(mask.v[i]) & simd_detail::bits_of(a.v[i])))
+}
+
+// same NaN behaviour as the SSE versions: second operand wins
+inline Float4 vmin(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(a.v[i] < b.v[i] ? a.v[i] : b.v[i]) }
+inline Float4 vmax(const Float4& a, const Float4& b) { OLLYGON_FLOAT4_LANEWISE(a.v[i] > b.v[i] ? a.v[i] : b.v[i]) }
+inline Float4 vsqrt(const Float4& a) { OLLYGON_FLOAT4_LANEWISE(std::sqrt(a.v[i])) }
+inline Float4 vabs(const Float4& a) { OLLYGON_FLOAT4_LANEWISE(std::abs(a.v[i])) }
+inline Float4 vexp(const Float4& a) { OLLYGON_FLOAT4_LANEWISE(std::exp(std::min(std::max(a.v[i], -87.0f), 88.0f))) }
+
+inline void store_int(const Float4& a, int32_t* p) {
+    for (int i = 0; i < 4; ++i) p[i] = int32_t(a.v[i]);
+}
+
+inline Float4 select(const Float4& mask, const Float4& a, const Float4& b) {
+    OLLYGON_FLOAT4_LANEWISE(simd_detail::bits_of(mask.v[i]) ? a.v[i] : b.v[i])
+}
+
+inline int movemask(const Float4& mask) {
+    int bits = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (simd_detail::bits_of(mask.v[i]) & 0x80000000u) bits |= 1 << i;
+    }
+    return bits;
+}
+
+#undef OLLYGON_FLOAT4_LANEWISE
+
+#endif
+
+inline bool any(const Float4& mask) { return movemask(mask) != 0; }
+inline bool none(const Float4& mask) { return movemask(mask) == 0; }
+
+inline Float4 all_lanes() { return Float4(0.0f) <= Float4(0.0f); }
+
+// horizontal min over the lanes set in mask, +inf if none
+inline float hmin(const Float4& a, const Float4& mask) {
+    float result = std::numeric_limits<float>::infinity();
+    int bits = movemask(mask);
+    for (int i = 0; i < 4; ++i) {
+        if (bits & (1 << i)) result = std::min(result, a[i]);
+    }
+    return result;
+}
+
+} // namespace okaytracer
+} // namespace ollygon
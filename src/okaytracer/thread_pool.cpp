@@ -0,0 +1,131 @@
+#define NOMINMAX
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace ollygon {
+namespace okaytracer {
+
+ThreadPool::ThreadPool(int num_threads)
+    : current_task(nullptr)
+    , remaining(0)
+    , generation(0)
+    , shutting_down(false)
+{
+    int worker_count = std::max(1, num_threads) - 1;
+
+    for (int i = 0; i < worker_count + 1; ++i) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    workers.reserve(worker_count);
+    for (int i = 0; i < worker_count; ++i) {
+        workers.emplace_back([this, i]() { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shutting_down = true;
+    }
+    wake_workers.notify_all();
+
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::parallel_for(int count, const std::function<void(int)>& task) {
+    if (count <= 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_task = &task;
+        remaining = count;
+
+        // contiguous runs per queue, so neighbouring tiles start on the same thread
+        int num_queues = int(queues.size());
+        for (int q = 0; q < num_queues; ++q) {
+            int begin = int(int64_t(count) * q / num_queues);
+            int end = int(int64_t(count) * (q + 1) / num_queues);
+
+            std::lock_guard<std::mutex> queue_lock(queues[q]->mutex);
+            for (int i = begin; i < end; ++i) {
+                queues[q]->items.push_back(i);
+            }
+        }
+
+        generation++;
+    }
+    wake_workers.notify_all();
+
+    // caller owns the last queue and works through it like any other worker
+    const int caller_queue = int(queues.size()) - 1;
+    int item;
+    while (pop_local(caller_queue, item) || steal(caller_queue, item)) {
+        run_item(item);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    batch_done.wait(lock, [this]() { return remaining.load() == 0; });
+    current_task = nullptr;
+}
+
+void ThreadPool::worker_loop(int queue_index) {
+    // the caller is 0, workers follow
+    current_thread_index = queue_index + 1;
+    uint64_t seen_generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake_workers.wait(lock, [&]() { return shutting_down || generation != seen_generation; });
+            if (shutting_down) return;
+            seen_generation = generation;
+        }
+
+        int item;
+        while (pop_local(queue_index, item) || steal(queue_index, item)) {
+            run_item(item);
+        }
+    }
+}
+
+bool ThreadPool::pop_local(int queue_index, int& item) {
+    WorkQueue& queue = *queues[queue_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.items.empty()) return false;
+    item = queue.items.front();
+    queue.items.pop_front();
+    return true;
+}
+
+bool ThreadPool::steal(int thief_index, int& item) {
+    int num_queues = int(queues.size());
+    for (int offset = 1; offset < num_queues; ++offset) {
+        WorkQueue& victim = *queues[(thief_index + offset) % num_queues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.items.empty()) continue;
+        // take from the far end, away from where the owner is working
+        item = victim.items.back();
+        victim.items.pop_back();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run_item(int item) {
+    // safe to read without the pool mutex: the task is published before any
+    // items are queued, and can't be retired until this item is counted off
+    (*current_task)(item);
+
+    if (remaining.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch_done.notify_all();
+    }
+}
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace ollygon {
+namespace okaytracer {
+
+// persistent pool of worker threads with one work queue each.  a batch of
+// tasks is split into contiguous runs across the queues; workers pop from the
+// front of their own and steal from the back of everyone else's once empty,
+// so a slow tile doesn't hold up the rest of the pass
+class ThreadPool {
+public:
+    // num_threads includes the calling thread, which helps out in parallel_for
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // runs task(i) for every i in [0, count) and blocks until all have finished
+    void parallel_for(int count, const std::function<void(int)>& task);
+
+    int size() const { return int(workers.size()) + 1; }
+
+    // which of the pool's threads this is, in [0, size()).  0 is whoever called
+    // parallel_for, and any thread outside the pool, so per-thread data can be
+    // indexed without locking
+    static int thread_index() { return current_thread_index; }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<int> items;
+    };
+
+    void worker_loop(int queue_index);
+
+    bool pop_local(int queue_index, int& item);
+    bool steal(int thief_index, int& item);
+    void run_item(int item);
+
+    static inline thread_local int current_thread_index = 0;
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues; // one per worker, plus one for the caller
+
+    std::mutex mutex;
+    std::condition_variable wake_workers;
+    std::condition_variable batch_done;
+
+    const std::function<void(int)>* current_task;
+    std::atomic<int> remaining;
+    uint64_t generation;
+    bool shutting_down;
+};
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,82 @@
+#define NOMINMAX
+
+#include "tonemap.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+namespace ollygon {
+namespace okaytracer {
+
+namespace {
+
+// enough per task that the pool's overhead stays small next to the work
+constexpr int ROWS_PER_TASK = 16;
+
+inline uint32_t pack_rgb32(int32_t r, int32_t g, int32_t b) {
+    return 0xff000000u | (uint32_t(r) << 16) | (uint32_t(g) << 8) | uint32_t(b);
+}
+
+void tonemap_row(const float* src, int width, uint32_t* dest) {
+    const Float4 zero(0.0f);
+    const Float4 one(1.0f);
+    const Float4 scale(255.99f);
+
+    // 4 pixels are 3 whole Float4s of interleaved rgb, so no shuffling until the pack.
+    // max before min sends NaNs to black, as the second operand wins
+    int x = 0;
+    int32_t channels[12];
+    for (; x + 4 <= width; x += 4) {
+        const float* p = src + size_t(x) * 3;
+        for (int i = 0; i < 3; ++i) {
+            Float4 v = vmin(vmax(Float4::load(p + i * 4), zero), one);
+            store_int(vsqrt(v) * scale, channels + i * 4);
+        }
+        for (int i = 0; i < 4; ++i) {
+            dest[x + i] = pack_rgb32(channels[i * 3 + 0], channels[i * 3 + 1], channels[i * 3 + 2]);
+        }
+    }
+
+    for (; x < width; ++x) {
+        const float* p = src + size_t(x) * 3;
+        int32_t c[3];
+        for (int i = 0; i < 3; ++i) {
+            float v = p[i] > 0.0f ? std::min(p[i], 1.0f) : 0.0f;
+            c[i] = int32_t(std::sqrt(v) * 255.99f);
+        }
+        dest[x] = pack_rgb32(c[0], c[1], c[2]);
+    }
+}
+
+} // namespace
+
+void tonemap_rgb32(const float* pixels, int width, int height, uint8_t* dest, size_t dest_stride, ThreadPool* pool)
+{
+    auto tonemap_rows = [&](int task) {
+        const int start_y = task * ROWS_PER_TASK;
+        const int end_y = std::min(start_y + ROWS_PER_TASK, height);
+        tonemap_rgb32_region(pixels, width, 0, width, start_y, end_y, dest, dest_stride);
+    };
+
+    const int tasks = (height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+    if (pool && tasks > 1) {
+        pool->parallel_for(tasks, tonemap_rows);
+    }
+    else {
+        for (int task = 0; task < tasks; ++task) {
+            tonemap_rows(task);
+        }
+    }
+}
+
+void tonemap_rgb32_region(const float* pixels, int width, int start_x, int end_x, int start_y, int end_y,
+    uint8_t* dest, size_t dest_stride)
+{
+    for (int y = start_y; y < end_y; ++y) {
+        const float* src = pixels + (size_t(y) * width + start_x) * 3;
+        uint32_t* row = reinterpret_cast<uint32_t*>(dest + size_t(y) * dest_stride) + start_x;
+        tonemap_row(src, end_x - start_x, row);
+    }
+}
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ollygon {
+namespace okaytracer {
+
+class ThreadPool;
+
+// linear rgb floats (interleaved, top row first like Raytracer::get_pixels()) to
+// 8 bit, with the clamp and gamma 2 every ollygon display uses.  dest rows are
+// width 0xffRRGGBB words, ie QImage::Format_RGB32, dest_stride bytes apart so a
+// QImage's bits() and bytesPerLine() go straight in.  rows are shared out over
+// pool when there is one
+void tonemap_rgb32(const float* pixels, int width, int height, uint8_t* dest, size_t dest_stride, ThreadPool* pool = nullptr);
+
+// same, for just [start_x, end_x) x [start_y, end_y) of a width wide image, into
+// the same place in dest.  on the calling thread, for redrawing a tile at a time
+void tonemap_rgb32_region(const float* pixels, int width, int start_x, int end_x, int start_y, int end_y,
+    uint8_t* dest, size_t dest_stride);
+
+} // namespace okaytracer
+} // namespace ollygon
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+
+namespace ollygon {
+namespace okaytracer {
+
+// lock-free handoff of whole frames from one producer thread to one consumer.
+// the producer always has a buffer of its own to fill and the consumer one to
+// read, the third holds the latest published frame.  neither side ever waits,
+// frames the consumer didn't get round to are simply overwritten
+template <typename T>
+class TripleBuffer {
+public:
+    // producer side
+    T& write_buffer() { return buffers[write_index]; }
+    void publish() {
+        write_index = ready.exchange(write_index | FRESH) & INDEX_MASK;
+    }
+
+    // consumer side.  swaps in the latest frame if there's one it hasn't seen,
+    // returns whether read_buffer() changed
+    bool acquire() {
+        if (!(ready.load() & FRESH)) return false;
+        read_index = ready.exchange(read_index) & INDEX_MASK;
+        return true;
+    }
+    const T& read_buffer() const { return buffers[read_index]; }
+
+private:
+    static constexpr int INDEX_MASK = 0x3;
+    static constexpr int FRESH = 0x4; // set on ready when it's been published but not acquired
+
+    T buffers[3];
+    int write_index = 0;
+    int read_index = 1;
+    std::atomic<int> ready{ 2 };
+};
+
+} // namespace okaytracer
+} // namespace ollygon
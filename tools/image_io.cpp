@@ -0,0 +1,147 @@
+#define NOMINMAX
+
+#include "image_io.hpp"
+#include "okaytracer/tonemap.hpp"
+
+#include <QImage>
+#include <QString>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace ollygon {
+namespace tools {
+
+namespace {
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    if (s.size() < suffix.size()) return false;
+    // suffix is lowercase, s might not be
+    return std::equal(suffix.rbegin(), suffix.rend(), s.rbegin(), [](char a, char b) {
+        return a == std::tolower((unsigned char)b);
+    });
+}
+
+} // namespace
+
+bool write_pfm(const std::string& path, int width, int height, const std::vector<float>& pixels)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "failed to open " << path << " for writing\n";
+        return false;
+    }
+
+    // negative scale means little endian, which is everything we build for
+    std::fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
+    for (int y = height - 1; y >= 0; --y) {
+        std::fwrite(&pixels[size_t(y) * width * 3], sizeof(float), size_t(width) * 3, file);
+    }
+
+    bool ok = std::ferror(file) == 0;
+    std::fclose(file);
+    return ok;
+}
+
+bool write_png(const std::string& path, int width, int height, const std::vector<float>& pixels)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    okaytracer::tonemap_rgb32(pixels.data(), width, height, image.bits(), size_t(image.bytesPerLine()));
+
+    if (!image.save(QString::fromStdString(path), "PNG")) {
+        std::cerr << "failed to write " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool write_image(const std::string& path, int width, int height, const std::vector<float>& pixels)
+{
+    if (ends_with(path, ".pfm")) return write_pfm(path, width, height, pixels);
+    if (ends_with(path, ".png")) return write_png(path, width, height, pixels);
+
+    std::cerr << "don't know how to write " << path << ", use .pfm (float) or .png\n";
+    return false;
+}
+
+bool same_frame(const Accumulation& a, const Accumulation& b)
+{
+    return a.width == b.width && a.height == b.height && a.seed == b.seed
+        && a.max_bounces == b.max_bounces && a.backend == b.backend && a.sampler == b.sampler
+        && a.light_sampling == b.light_sampling && a.packet_primary_rays == b.packet_primary_rays
+        && a.scene_hash == b.scene_hash
+        && std::memcmp(a.camera_pos, b.camera_pos, sizeof(a.camera_pos)) == 0
+        && std::memcmp(a.camera_target, b.camera_target, sizeof(a.camera_target)) == 0
+        && std::memcmp(a.camera_up, b.camera_up, sizeof(a.camera_up)) == 0
+        && a.camera_fov == b.camera_fov;
+}
+
+bool write_accumulation(const std::string& path, const Accumulation& accumulation)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "failed to open " << path << " for writing\n";
+        return false;
+    }
+
+    // 9 significant digits round trip a float exactly, so same_frame can compare cameras bit for bit
+    const Accumulation& a = accumulation;
+    std::fprintf(file, "OACC\n%d %d\n%d %d %llu\n%d %d %d %d %d\n%llx\n%.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+        a.width, a.height,
+        a.first_sample, a.samples, (unsigned long long)a.seed,
+        a.max_bounces, a.backend, a.sampler, a.light_sampling, a.packet_primary_rays,
+        (unsigned long long)a.scene_hash,
+        a.camera_pos[0], a.camera_pos[1], a.camera_pos[2],
+        a.camera_target[0], a.camera_target[1], a.camera_target[2],
+        a.camera_up[0], a.camera_up[1], a.camera_up[2],
+        a.camera_fov);
+    std::fwrite(accumulation.pixels.data(), sizeof(float), accumulation.pixels.size(), file);
+
+    bool ok = std::ferror(file) == 0;
+    std::fclose(file);
+    return ok;
+}
+
+bool read_accumulation(const std::string& path, Accumulation& accumulation)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "failed to open " << path << "\n";
+        return false;
+    }
+
+    unsigned long long seed = 0, scene_hash = 0;
+    Accumulation& a = accumulation;
+    // the header's last newline is checked by hand, a trailing space in the format
+    // would skip on into floats that happen to look like whitespace
+    bool ok = std::fscanf(file, "OACC %d %d %d %d %llu %d %d %d %d %d %llx %f %f %f %f %f %f %f %f %f %f",
+        &a.width, &a.height,
+        &a.first_sample, &a.samples, &seed,
+        &a.max_bounces, &a.backend, &a.sampler, &a.light_sampling, &a.packet_primary_rays,
+        &scene_hash,
+        &a.camera_pos[0], &a.camera_pos[1], &a.camera_pos[2],
+        &a.camera_target[0], &a.camera_target[1], &a.camera_target[2],
+        &a.camera_up[0], &a.camera_up[1], &a.camera_up[2],
+        &a.camera_fov) == 21
+        && std::fgetc(file) == '\n'
+        && accumulation.width > 0 && accumulation.height > 0 && accumulation.samples > 0;
+
+    if (ok) {
+        accumulation.seed = seed;
+        accumulation.scene_hash = scene_hash;
+        accumulation.pixels.resize(size_t(accumulation.width) * accumulation.height * 3);
+        ok = std::fread(accumulation.pixels.data(), sizeof(float), accumulation.pixels.size(), file)
+            == accumulation.pixels.size();
+    }
+    std::fclose(file);
+
+    if (!ok) {
+        std::cerr << path << " isn't an accumulation, or is cut short\n";
+    }
+    return ok;
+}
+
+} // namespace tools
+} // namespace ollygon
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+namespace ollygon {
+namespace tools {
+
+// pixels are linear rgb floats, interleaved, top row first like Raytracer::get_pixels()
+
+// portable float map, lossless.  stored bottom row first as the format wants
+bool write_pfm(const std::string& path, int width, int height, const std::vector<float>& pixels);
+
+// 8 bit, same clamp and gamma 2 as the raytracer window shows
+bool write_png(const std::string& path, int width, int height, const std::vector<float>& pixels);
+
+// picks the writer from path's extension, false (with a message) if none fits
+bool write_image(const std::string& path, int width, int height, const std::vector<float>& pixels);
+
+// one render's share of a frame split over several: the mean of passes
+// [first_sample, first_sample + samples) with the given seed.  shares of one
+// frame average together, weighted by samples, into the frame rendered whole
+struct Accumulation {
+    int width = 0;
+    int height = 0;
+    int first_sample = 0;
+    int samples = 0;
+    uint64_t seed = 0;
+
+    // the RenderConfig settings that change what a pass adds, as ints
+    int max_bounces = 0;
+    int backend = 0;
+    int sampler = 0;
+    int light_sampling = 0;
+    int packet_primary_rays = 0;
+
+    // what was rendered: a hash of the scene file, and the camera it was seen from
+    uint64_t scene_hash = 0;
+    float camera_pos[3] = {};
+    float camera_target[3] = {};
+    float camera_up[3] = {};
+    float camera_fov = 0.0f;
+
+    std::vector<float> pixels;
+};
+
+// whether a and b can be merged, ie the same scene, camera, size, seed and settings
+bool same_frame(const Accumulation& a, const Accumulation& b);
+
+// .acc, a short text header then the floats as they are in memory (so little endian)
+bool write_accumulation(const std::string& path, const Accumulation& accumulation);
+bool read_accumulation(const std::string& path, Accumulation& accumulation);
+
+} // namespace tools
+} // namespace ollygon
@@ -0,0 +1,646 @@
+// ollygon_bench - raytracer micro and macro benchmarks, results as json on stdout.
+// micro: single rays against one sphere/quad/triangle.  macro: whole frames of
+// canonical scenes through each CPU integrator, plus scene conversion and obj import
+#define NOMINMAX
+
+#include "core/scene.hpp"
+#include "core/camera.hpp"
+#include "core/constants.hpp"
+#include "core/io/import_mesh.hpp"
+#include "okaytracer/render_scene.hpp"
+#include "okaytracer/raytracer.hpp"
+#include "okaytracer/tonemap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace ollygon;
+
+namespace {
+
+struct Options {
+    bool quick = false;  // fewer rays, samples and smaller frames, for a smoke test
+    int threads = 0;
+    std::string filter;  // only benchmarks whose group/name contains this
+};
+
+void print_usage() {
+    std::cerr <<
+        "usage: ollygon_bench [options]\n"
+        "  --quick                 smaller workloads, for checking it runs rather than timing\n"
+        "  --threads <n>           for the frame benchmarks, default one per hardware thread\n"
+        "  --filter <text>         only run benchmarks whose group/name contains text\n";
+}
+
+bool parse_args(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if (arg == "--quick") {
+            options.quick = true;
+        }
+        else if ((arg == "--threads" || arg == "--filter") && i + 1 < argc) {
+            if (arg == "--threads") options.threads = std::atoi(argv[++i]);
+            else options.filter = argv[++i];
+        }
+        else {
+            if (arg != "-h" && arg != "--help") std::cerr << "unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// == results ==
+
+// one line of the results array, metrics in the order they were added
+struct Result {
+    std::string group;
+    std::string name;
+    std::vector<std::pair<std::string, double>> metrics;
+
+    Result& add(const std::string& key, double value) {
+        metrics.emplace_back(key, value);
+        return *this;
+    }
+};
+
+std::vector<Result> results;
+
+Result& add_result(const std::string& group, const std::string& name) {
+    results.push_back({ group, name, {} });
+    std::cerr << group << "/" << name << "\n";
+    return results.back();
+}
+
+void print_results(const Options& options, int threads) {
+    std::printf("{\"quick\": %s, \"threads\": %d, \"results\": [\n", options.quick ? "true" : "false", threads);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        std::printf("  {\"group\": \"%s\", \"name\": \"%s\"", result.group.c_str(), result.name.c_str());
+        for (const auto& metric : result.metrics) {
+            std::printf(", \"%s\": %.10g", metric.first.c_str(), metric.second);
+        }
+        std::printf("}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::printf("]}\n");
+}
+
+// == scenes ==
+
+// uv sphere, smooth normals.  segments around, segments / 2 top to bottom
+void add_uv_sphere(Geo& geo, float radius, int segments) {
+    const int rings = segments / 2;
+    const uint32_t base = uint32_t(geo.vertex_count());
+
+    for (int ring = 0; ring <= rings; ++ring) {
+        const float theta = PI * float(ring) / float(rings);
+        for (int seg = 0; seg <= segments; ++seg) {
+            const float phi = 2.0f * PI * float(seg) / float(segments);
+            Vec3 normal(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+            geo.add_vertex(normal * radius, normal);
+        }
+    }
+
+    const uint32_t row = uint32_t(segments + 1);
+    for (int ring = 0; ring < rings; ++ring) {
+        for (int seg = 0; seg < segments; ++seg) {
+            const uint32_t i0 = base + uint32_t(ring) * row + uint32_t(seg);
+            const uint32_t i1 = i0 + row;
+            geo.add_tri(i0, i1, i0 + 1);
+            geo.add_tri(i0 + 1, i1, i1 + 1);
+        }
+    }
+}
+
+void add_quad(Scene& scene, const char* name, const Vec3& u, const Vec3& v, const Vec3& position, const Material& material) {
+    auto node = std::make_unique<SceneNode>(name);
+    node->node_type = NodeType::Primitive;
+    node->primitive = std::make_unique<QuadPrimitive>(u, v);
+    node->transform.position = position;
+    node->material = material;
+    scene.get_root()->add_child(std::move(node));
+}
+
+void add_sphere(Scene& scene, const char* name, float radius, const Vec3& position, const Material& material) {
+    auto node = std::make_unique<SceneNode>(name);
+    node->node_type = NodeType::Primitive;
+    node->primitive = std::make_unique<SpherePrimitive>(radius);
+    node->transform.position = position;
+    node->material = material;
+    scene.get_root()->add_child(std::move(node));
+}
+
+// the walls and light of MainWindow::setup_scene_cornell_box(), which the
+// default camera looks into
+void add_cornell_room(Scene& scene) {
+    const float room_size = 5.55f;
+    const float half_room = room_size * 0.5f;
+    const Colour white(0.73f, 0.73f, 0.73f);
+
+    add_quad(scene, "Left Wall", Vec3(0, half_room, 0), Vec3(0, 0, half_room),
+        Vec3(0, half_room, half_room), Material::lambertian(Colour(0.65f, 0.05f, 0.05f)));
+    add_quad(scene, "Right Wall", Vec3(0, 0, half_room), Vec3(0, half_room, 0),
+        Vec3(room_size, half_room, half_room), Material::lambertian(Colour(0.12f, 0.45f, 0.15f)));
+    add_quad(scene, "Floor", Vec3(half_room, 0, 0), Vec3(0, half_room, 0),
+        Vec3(half_room, half_room, 0), Material::lambertian(white));
+    add_quad(scene, "Ceiling", Vec3(0, half_room, 0), Vec3(half_room, 0, 0),
+        Vec3(half_room, half_room, room_size), Material::lambertian(white));
+    add_quad(scene, "Back Wall", Vec3(0, 0, half_room), Vec3(-half_room, 0, 0),
+        Vec3(half_room, room_size, half_room), Material::lambertian(white));
+
+    const Colour light_emission(25.0f, 20.0f, 15.0f);
+    auto light_node = std::make_unique<SceneNode>("Area Light");
+    light_node->node_type = NodeType::Light;
+    light_node->light = std::make_unique<Light>();
+    light_node->light->type = LightType::Area;
+    light_node->light->colour = light_emission;
+    light_node->light->intensity = 1.0f;
+    light_node->light->is_area_light = true;
+    light_node->primitive = std::make_unique<QuadPrimitive>(Vec3(0, 0.525f, 0), Vec3(0.65f, 0, 0));
+    light_node->transform.position = Vec3(2.775f, 2.775f, 5.54f);
+    light_node->material = Material::emissive(light_emission);
+    scene.get_root()->add_child(std::move(light_node));
+}
+
+// the window's default scene, boxes, spheres and all
+void build_cornell_box(Scene& scene) {
+    add_cornell_room(scene);
+
+    auto tall_box = std::make_unique<SceneNode>("Tall Box");
+    tall_box->node_type = NodeType::Primitive;
+    tall_box->primitive = std::make_unique<CuboidPrimitive>(Vec3(1.65f, 1.65f, 3.3f));
+    tall_box->transform.position = Vec3(1.850f, 3.59f, 1.65f);
+    tall_box->transform.rotation.z = 15.0f;
+    tall_box->material = Material::lambertian(Colour(1.0f, 0.6f, 0.2f));
+    scene.get_root()->add_child(std::move(tall_box));
+
+    auto short_box = std::make_unique<SceneNode>("Short Box");
+    short_box->node_type = NodeType::Primitive;
+    short_box->primitive = std::make_unique<CuboidPrimitive>(Vec3(1.65f, 1.65f, 1.65f));
+    short_box->transform.position = Vec3(3.7f, 1.8f, 0.825f);
+    short_box->transform.rotation.z = -18.0f;
+    short_box->material = Material::chequerboard(Colour(1.0f, 0.9f, 0.3f), Colour(0.65f, 0.05f, 0.05f), 4.0f);
+    scene.get_root()->add_child(std::move(short_box));
+
+    add_sphere(scene, "Sphere", 0.5f, Vec3(3.700f, 1.8f, 2.150f), Material::metal(Colour(0.19f, 0.18f, 0.9f)));
+    add_sphere(scene, "Sphere2", 1.0f, Vec3(1.415f, 2.335f, 3.480f), Material::dielectric(2.85f));
+}
+
+// cornell room around one dense mesh, so the frame is dominated by triangles
+void build_cornell_mesh(Scene& scene, int segments) {
+    add_cornell_room(scene);
+
+    auto mesh = std::make_unique<SceneNode>("Mesh Sphere");
+    mesh->node_type = NodeType::Mesh;
+    mesh->geo = std::make_unique<Geo>();
+    add_uv_sphere(*mesh->geo, 1.5f, segments);
+    mesh->transform.position = Vec3(2.775f, 2.775f, 1.6f);
+    mesh->material = Material::lambertian(Colour(0.8f, 0.8f, 0.8f));
+    scene.get_root()->add_child(std::move(mesh));
+}
+
+// cornell room with a 7x7 grid of the same mesh, each turned and scaled a
+// little.  shared puts one Geo on every node so they become instances,
+// otherwise each node gets its own copy and is baked, to compare the two
+void build_instanced_meshes(Scene& scene, int segments, bool shared) {
+    add_cornell_room(scene);
+
+    std::shared_ptr<Geo> geo = std::make_shared<Geo>();
+    add_uv_sphere(*geo, 0.3f, segments);
+
+    for (int y = 0; y < 7; ++y) {
+        for (int x = 0; x < 7; ++x) {
+            auto node = std::make_unique<SceneNode>("Instance");
+            node->node_type = NodeType::Mesh;
+            node->geo = shared ? geo : std::make_shared<Geo>(*geo);
+            node->transform.position = Vec3(0.6f + 0.725f * x, 0.6f + 0.725f * y, 2.5f);
+            node->transform.rotation = Vec3(15.0f * x, 20.0f * y, 0.0f);
+            node->transform.scale = Vec3(1.0f, 0.6f + 0.1f * ((x + y) % 5), 1.0f);
+            node->material = Material::lambertian(Colour(0.2f + 0.1f * x, 0.8f, 0.2f + 0.1f * y));
+            scene.get_root()->add_child(std::move(node));
+        }
+    }
+}
+
+// cornell room filled with count small spheres of every material, seeded so
+// each run gets the same ones
+void build_random_spheres(Scene& scene, int count) {
+    add_cornell_room(scene);
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    for (int i = 0; i < count; ++i) {
+        const float radius = 0.05f + 0.15f * unit(rng);
+        const Vec3 position(
+            0.3f + 4.95f * unit(rng),
+            0.3f + 4.95f * unit(rng),
+            0.3f + 4.6f * unit(rng));
+        const Colour colour(unit(rng), unit(rng), unit(rng));
+
+        const float pick = unit(rng);
+        Material material = pick < 0.7f ? Material::lambertian(colour)
+            : pick < 0.9f ? Material::metal(colour, 0.2f * unit(rng))
+            : Material::dielectric(1.5f);
+        add_sphere(scene, "Sphere", radius, position, material);
+    }
+}
+
+} // namespace
+
+namespace ollygon {
+namespace okaytracer {
+
+// friend of Raytracer, for calling the intersection routines directly
+class RaytracerBenchmark {
+public:
+    // rays from random points on a sphere around the target, aimed at random
+    // points near it so roughly half hit
+    static std::vector<Ray> make_rays(int count, const Vec3& target, float spread) {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        auto random_in_cube = [&]() { return Vec3(unit(rng), unit(rng), unit(rng)); };
+
+        std::vector<Ray> rays;
+        rays.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            Vec3 origin = target + random_in_cube().normalised() * (spread * 4.0f);
+            Vec3 aim = target + random_in_cube() * spread;
+            rays.emplace_back(origin, (aim - origin).normalised());
+        }
+        return rays;
+    }
+
+    template <typename Intersect>
+    static void run_micro(const char* name, const std::vector<Ray>& rays, int repeats, Intersect intersect) {
+        int hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            for (const Ray& ray : rays) {
+                Intersection rec;
+                hits += intersect(ray, rec) ? 1 : 0;
+            }
+        }
+        const double ms = ms_since(start);
+        const double ray_count = double(rays.size()) * repeats;
+
+        add_result("intersect", name)
+            .add("rays", ray_count)
+            .add("ms", ms)
+            .add("mrays_per_s", ray_count / (ms * 1000.0))
+            .add("ns_per_ray", ms * 1e6 / ray_count)
+            .add("hit_rate", double(hits) / ray_count);
+    }
+
+    static void micro(const Options& options) {
+        const int ray_count = 1 << 16;
+        const int repeats = options.quick ? 4 : 64;
+        const std::vector<Ray> rays = make_rays(ray_count, Vec3(0, 0, 0), 1.0f);
+
+        Raytracer raytracer(1);
+        const float t_max = 1e30f;
+
+        RenderPrimitive sphere;
+        sphere.type = RenderPrimitive::Type::Sphere;
+        sphere.centre = Vec3(0, 0, 0);
+        sphere.radius = 0.7f;
+
+        RenderPrimitive quad;
+        quad.type = RenderPrimitive::Type::Quad;
+        quad.quad_corner = Vec3(-0.7f, -0.7f, 0);
+        quad.quad_u = Vec3(1.4f, 0, 0);
+        quad.quad_v = Vec3(0, 1.4f, 0);
+        quad.quad_normal = Vec3(0, 0, 1);
+
+        // intersect_triangle reads the mesh through the raytracer's own scene
+        RenderMesh mesh;
+        mesh.positions = { Vec3(-0.9f, -0.9f, 0), Vec3(0.9f, -0.9f, 0), Vec3(0, 0.9f, 0) };
+        mesh.normals = { Vec3(0, 0, 1), Vec3(0, 0, 1), Vec3(0, 0, 1) };
+        mesh.indices = { 0, 1, 2 };
+        raytracer.scene.meshes.push_back(mesh);
+        const RenderTriangle tri = { 0, 0 };
+
+        if (matches(options, "intersect", "sphere")) {
+            run_micro("sphere", rays, repeats, [&](const Ray& ray, Intersection& rec) {
+                return raytracer.intersect_sphere(sphere, ray, 0.001f, t_max, rec);
+            });
+        }
+        if (matches(options, "intersect", "quad")) {
+            run_micro("quad", rays, repeats, [&](const Ray& ray, Intersection& rec) {
+                return raytracer.intersect_quad(quad, ray, 0.001f, t_max, rec);
+            });
+        }
+        if (matches(options, "intersect", "triangle")) {
+            run_micro("triangle", rays, repeats, [&](const Ray& ray, Intersection& rec) {
+                return raytracer.intersect_triangle(tri, ray, 0.001f, t_max, rec);
+            });
+        }
+    }
+
+    static bool matches(const Options& options, const std::string& group, const std::string& name) {
+        return options.filter.empty() || (group + "/" + name).find(options.filter) != std::string::npos;
+    }
+};
+
+} // namespace okaytracer
+} // namespace ollygon
+
+namespace {
+
+using okaytracer::RaytracerBenchmark;
+
+struct Variant {
+    const char* name;
+    okaytracer::RenderBackend backend;
+    bool packets;
+};
+
+// the CPU integrators we ship, each renders every scene
+const Variant VARIANTS[] = {
+    { "cpu", okaytracer::RenderBackend::CPU, true },
+    { "cpu_no_packets", okaytracer::RenderBackend::CPU, false },
+    { "wavefront", okaytracer::RenderBackend::CPUWavefront, true },
+};
+
+void bench_frames(const Options& options, const char* scene_name, const Scene& scene) {
+    // conversion is timed once per scene, it doesn't depend on the variant
+    auto convert_start = std::chrono::steady_clock::now();
+    okaytracer::RenderScene render_scene = okaytracer::RenderScene::from_scene(&scene);
+    const double convert_ms = ms_since(convert_start);
+
+    if (RaytracerBenchmark::matches(options, "from_scene", scene_name)) {
+        add_result("from_scene", scene_name)
+            .add("ms", convert_ms)
+            .add("primitives", double(render_scene.primitives.size()))
+            .add("triangles", double(render_scene.triangles.size()))
+            .add("instances", double(render_scene.instances.size()));
+    }
+
+    Camera camera;
+    okaytracer::RenderConfig config;
+    config.width = options.quick ? 128 : 400;
+    config.height = config.width;
+    config.samples_per_pixel = options.quick ? 2 : 16;
+    config.noise_threshold = 0.0f; // a fixed amount of work, whatever the noise
+    camera.set_aspect(float(config.width) / float(config.height));
+
+    for (const Variant& variant : VARIANTS) {
+        const std::string name = std::string(scene_name) + "/" + variant.name;
+        if (!RaytracerBenchmark::matches(options, "frame", name)) continue;
+
+        config.backend = variant.backend;
+        config.packet_primary_rays = variant.packets;
+
+        okaytracer::Raytracer raytracer(options.threads);
+
+        auto build_start = std::chrono::steady_clock::now();
+        raytracer.start_render(render_scene, camera, config);
+        const double build_ms = ms_since(build_start);
+
+        auto render_start = std::chrono::steady_clock::now();
+        while (raytracer.is_rendering()) {
+            raytracer.render_one_sample();
+        }
+        const double render_ms = ms_since(render_start);
+
+        // rates are over the passes alone, the stats' wall time doesn't include setup
+        const okaytracer::RenderStats& stats = raytracer.get_stats();
+        const double rays = double(std::max<uint64_t>(stats.rays, 1));
+        add_result("frame", name)
+            .add("width", config.width)
+            .add("height", config.height)
+            .add("spp", raytracer.get_current_sample())
+            .add("build_ms", build_ms)
+            .add("render_ms", render_ms)
+            .add("msamples_per_s", double(stats.paths) / (stats.wall_ms * 1000.0))
+            .add("mrays_per_s", stats.mrays_per_second())
+            .add("rays_per_sample", double(stats.rays) / double(std::max<uint64_t>(stats.paths, 1)))
+            .add("nodes_per_ray", double(stats.node_visits) / rays)
+            .add("tests_per_ray", double(stats.primitive_tests) / rays);
+    }
+}
+
+// how long start_render() takes to get going again after an edit, against
+// converting and building from scratch.  edits the scene's last node
+void bench_updates(const Options& options, const char* scene_name, Scene& scene) {
+    if (!RaytracerBenchmark::matches(options, "update", scene_name)) return;
+
+    Camera camera;
+    okaytracer::RenderConfig config;
+    config.width = 64;
+    config.height = 64;
+    okaytracer::Raytracer raytracer(options.threads);
+
+    auto timed_start = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        raytracer.start_render(&scene, camera, config);
+        const double ms = ms_since(start);
+        raytracer.stop_render();
+        return ms;
+    };
+
+    SceneNode* node = scene.get_root()->children.back().get();
+
+    const double full_ms = timed_start();
+    const double unchanged_ms = timed_start();
+
+    node->material.albedo = node->material.albedo * Colour(0.5f, 0.5f, 0.5f);
+    node->mark_dirty(NodeChange::Material);
+    const double material_ms = timed_start();
+
+    node->transform.position.z += 0.1f;
+    node->mark_dirty(NodeChange::Transform);
+    const double transform_ms = timed_start();
+
+    add_result("update", scene_name)
+        .add("full_ms", full_ms)
+        .add("unchanged_ms", unchanged_ms)
+        .add("material_ms", material_ms)
+        .add("transform_ms", transform_ms);
+}
+
+// float frame to 8 bit display pixels, as the raytracer window does every update.
+// the per pixel loop it used to be against tonemap_rgb32 alone and on a pool the
+// size of the window's
+void bench_tonemap(const Options& options) {
+    if (!RaytracerBenchmark::matches(options, "tonemap", "rgb32")) return;
+
+    const int width = options.quick ? 1920 : 3840;
+    const int height = options.quick ? 1080 : 2160;
+    const int repeats = options.quick ? 3 : 10;
+
+    // a little over 1 and a little under 0 too, so the clamps are exercised
+    std::vector<float> pixels(size_t(width) * height * 3);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> value(-0.1f, 1.2f);
+    for (float& p : pixels) p = value(rng);
+
+    std::vector<uint32_t> reference(size_t(width) * height);
+    std::vector<uint32_t> converted(size_t(width) * height);
+    const size_t stride = size_t(width) * sizeof(uint32_t);
+
+    auto best_of = [repeats](auto&& run) {
+        double best = 1e30;
+        for (int i = 0; i < repeats; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            run();
+            best = std::min(best, ms_since(start));
+        }
+        return best;
+    };
+
+    const double scalar_ms = best_of([&]() {
+        for (size_t i = 0; i < reference.size(); ++i) {
+            const float* p = &pixels[i * 3];
+            int r = int(std::sqrt(std::clamp(p[0], 0.0f, 1.0f)) * 255.99f);
+            int g = int(std::sqrt(std::clamp(p[1], 0.0f, 1.0f)) * 255.99f);
+            int b = int(std::sqrt(std::clamp(p[2], 0.0f, 1.0f)) * 255.99f);
+            reference[i] = 0xff000000u | (uint32_t(r) << 16) | (uint32_t(g) << 8) | uint32_t(b);
+        }
+    });
+
+    const double simd_ms = best_of([&]() {
+        okaytracer::tonemap_rgb32(pixels.data(), width, height, reinterpret_cast<uint8_t*>(converted.data()), stride);
+    });
+    const bool simd_matches = converted == reference;
+
+    okaytracer::ThreadPool pool(4);
+    std::fill(converted.begin(), converted.end(), 0u);
+    const double pool_ms = best_of([&]() {
+        okaytracer::tonemap_rgb32(pixels.data(), width, height, reinterpret_cast<uint8_t*>(converted.data()), stride, &pool);
+    });
+    const bool pool_matches = converted == reference;
+
+    if (!simd_matches || !pool_matches) {
+        std::cerr << "tonemap_rgb32 doesn't match the scalar conversion\n";
+    }
+
+    const double mpixels = double(width) * height / 1e6;
+    add_result("tonemap", "rgb32")
+        .add("mpixels", mpixels)
+        .add("scalar_ms", scalar_ms)
+        .add("simd_ms", simd_ms)
+        .add("pool4_ms", pool_ms)
+        .add("matches", simd_matches && pool_matches ? 1.0 : 0.0);
+}
+
+void bench_import(const Options& options) {
+    if (!RaytracerBenchmark::matches(options, "import", "obj")) return;
+
+    // written out fresh so the benchmark doesn't depend on any asset
+    Geo source;
+    add_uv_sphere(source, 1.0f, options.quick ? 128 : 512);
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "ollygon_bench.obj";
+    {
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "failed to write " << path.string() << "\n";
+            return;
+        }
+        char line[128];
+        for (const Vertex& v : source.verts) {
+            std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", v.position.x, v.position.y, v.position.z);
+            file << line;
+            std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", v.normal.x, v.normal.y, v.normal.z);
+            file << line;
+        }
+        for (size_t i = 0; i < source.indices.size(); i += 3) {
+            const uint32_t a = source.indices[i] + 1, b = source.indices[i + 1] + 1, c = source.indices[i + 2] + 1;
+            std::snprintf(line, sizeof(line), "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+            file << line;
+        }
+    }
+    const double megabytes = double(std::filesystem::file_size(path)) / (1024.0 * 1024.0);
+
+    // the importer reports progress on stdout, which is ours for the json
+    std::ostringstream import_log;
+    std::streambuf* cout_buffer = std::cout.rdbuf(import_log.rdbuf());
+
+    Geo geo;
+    auto start = std::chrono::steady_clock::now();
+    MeshImportResult import_result = MeshImporter::import_obj(path.string(), geo);
+    const double ms = ms_since(start);
+
+    std::cout.rdbuf(cout_buffer);
+
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+
+    if (import_result != MeshImportResult::Success) {
+        std::cerr << "obj import failed\n";
+        return;
+    }
+
+    add_result("import", "obj")
+        .add("triangles", double(geo.tri_count()))
+        .add("megabytes", megabytes)
+        .add("ms", ms)
+        .add("mtris_per_s", double(geo.tri_count()) / (ms * 1000.0))
+        .add("mb_per_s", megabytes / (ms / 1000.0));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_args(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    RaytracerBenchmark::micro(options);
+
+    {
+        Scene scene;
+        build_cornell_box(scene);
+        bench_frames(options, "cornell_box", scene);
+    }
+    {
+        Scene scene;
+        build_cornell_mesh(scene, options.quick ? 64 : 256);
+        bench_frames(options, "cornell_mesh", scene);
+        bench_updates(options, "cornell_mesh", scene);
+    }
+    {
+        Scene scene;
+        build_instanced_meshes(scene, options.quick ? 32 : 128, true);
+        bench_frames(options, "instances_shared", scene);
+    }
+    {
+        Scene scene;
+        build_instanced_meshes(scene, options.quick ? 32 : 128, false);
+        bench_frames(options, "instances_baked", scene);
+    }
+    {
+        const int counts[] = { 64, 1024 };
+        for (int count : counts) {
+            Scene scene;
+            build_random_spheres(scene, count);
+            bench_frames(options, ("spheres_" + std::to_string(count)).c_str(), scene);
+        }
+    }
+
+    bench_tonemap(options);
+    bench_import(options);
+
+    okaytracer::Raytracer sizing(options.threads);
+    print_results(options, sizing.get_thread_count());
+    return 0;
+}
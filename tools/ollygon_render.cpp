@@ -0,0 +1,383 @@
+// ollygon_render - renders a saved scene on the CPU without any UI, for render nodes.
+// no QApplication, QWidget or GL context, so it doesn't need a display.
+// a frame's samples can be split over several runs writing .acc files, then
+// put back together with --merge
+#define NOMINMAX
+
+#include "core/scene.hpp"
+#include "core/camera.hpp"
+#include "core/serialisation.hpp"
+#include "okaytracer/render_scene.hpp"
+#include "okaytracer/raytracer.hpp"
+#include "image_io.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace ollygon;
+
+namespace {
+
+struct Options {
+    std::string scene_path;
+    std::vector<std::string> merge_paths; // .acc files, when merging instead of rendering
+    std::string output_path = "render.png";
+    okaytracer::RenderConfig config;
+    int threads = 0;
+    std::string checkpoint_path; // empty for none
+    double checkpoint_seconds = 60.0;
+    bool denoise = false;
+    bool merge = false;
+};
+
+void print_usage() {
+    std::cerr <<
+        "usage: ollygon_render <scene.json> [options]\n"
+        "       ollygon_render --merge <a.acc> <b.acc> ... -o <path>\n"
+        "  -o, --output <path>     .png, .pfm or .acc (default render.png)\n"
+        "  --width <px>            default 600\n"
+        "  --height <px>           default 600\n"
+        "  --spp <n>               samples per pixel, the cap when --noise is on (default 1000)\n"
+        "  --bounces <n>           default 7\n"
+        "  --seed <n>              default 1\n"
+        "  --first-sample <n>      start at pass n of the seed's sequence (default 0)\n"
+        "  --threads <n>           default one per hardware thread\n"
+        "  --noise <f>             adaptive sampling threshold, 0 for off (default 0.01)\n"
+        "  --backend <name>        cpu or wavefront (default cpu)\n"
+        "  --sampler <name>        sobol or random (default sobol)\n"
+        "  --no-light-sampling\n"
+        "  --denoise               write the a-trous denoised image\n"
+        "  --checkpoint <path>     save progress there, and resume from it if it's this render's\n"
+        "  --checkpoint-every <s>  seconds between checkpoints (default 60)\n"
+        "  --merge                 average .acc files, weighted by their samples\n"
+        "\n"
+        "to split a frame, give each run the same seed and its own --first-sample and\n"
+        "--spp, and a .acc output.  .acc output turns adaptive sampling off, every pixel\n"
+        "has to have the same sample count for the merge's weights to be right\n";
+}
+
+bool is_accumulation(const std::string& path) {
+    return path.size() >= 4 && path.compare(path.size() - 4, 4, ".acc") == 0;
+}
+
+// false on anything unparseable, having said why
+bool parse_args(int argc, char* argv[], Options& options) {
+    // the window's defaults, so a scene renders the same either way
+    options.config.width = 600;
+    options.config.height = 600;
+    options.config.samples_per_pixel = 1000;
+    options.config.max_bounces = 7;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        // every option but the flags takes one value
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << arg << " needs a value\n";
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        }
+        else if (arg == "--no-light-sampling") {
+            options.config.light_sampling = false;
+        }
+        else if (arg == "--denoise") {
+            options.denoise = true;
+        }
+        else if (arg == "--merge") {
+            options.merge = true;
+        }
+        else if (arg[0] != '-') {
+            // sorted out once --merge has been seen or not
+            if (options.merge || !options.scene_path.empty()) {
+                options.merge_paths.push_back(arg);
+                continue;
+            }
+            options.scene_path = arg;
+        }
+        else {
+            const char* v = value();
+            if (!v) return false;
+
+            if (arg == "-o" || arg == "--output") options.output_path = v;
+            else if (arg == "--width") options.config.width = std::atoi(v);
+            else if (arg == "--height") options.config.height = std::atoi(v);
+            else if (arg == "--spp") options.config.samples_per_pixel = std::atoi(v);
+            else if (arg == "--bounces") options.config.max_bounces = std::atoi(v);
+            else if (arg == "--seed") options.config.seed = std::strtoull(v, nullptr, 10);
+            else if (arg == "--first-sample") options.config.first_sample = std::atoi(v);
+            else if (arg == "--threads") options.threads = std::atoi(v);
+            else if (arg == "--noise") options.config.noise_threshold = float(std::atof(v));
+            else if (arg == "--checkpoint") options.checkpoint_path = v;
+            else if (arg == "--checkpoint-every") options.checkpoint_seconds = std::atof(v);
+            else if (arg == "--backend") {
+                if (std::strcmp(v, "cpu") == 0) options.config.backend = okaytracer::RenderBackend::CPU;
+                else if (std::strcmp(v, "wavefront") == 0) options.config.backend = okaytracer::RenderBackend::CPUWavefront;
+                else {
+                    std::cerr << "unknown backend " << v << "\n";
+                    return false;
+                }
+            }
+            else if (arg == "--sampler") {
+                if (std::strcmp(v, "sobol") == 0) options.config.sampler = okaytracer::SamplerType::Sobol;
+                else if (std::strcmp(v, "random") == 0) options.config.sampler = okaytracer::SamplerType::Random;
+                else {
+                    std::cerr << "unknown sampler " << v << "\n";
+                    return false;
+                }
+            }
+            else {
+                std::cerr << "unknown option " << arg << "\n";
+                return false;
+            }
+        }
+    }
+
+    if (options.merge) {
+        // a path before --merge landed in scene_path
+        if (!options.scene_path.empty()) {
+            options.merge_paths.insert(options.merge_paths.begin(), options.scene_path);
+            options.scene_path.clear();
+        }
+        if (options.merge_paths.empty()) {
+            std::cerr << "nothing to merge\n";
+            return false;
+        }
+        return true;
+    }
+
+    if (options.scene_path.empty()) {
+        std::cerr << "no scene given\n";
+        return false;
+    }
+    if (!options.merge_paths.empty()) {
+        std::cerr << "more than one scene given\n";
+        return false;
+    }
+    if (options.config.width <= 0 || options.config.height <= 0 || options.config.samples_per_pixel <= 0) {
+        std::cerr << "width, height and spp must be positive\n";
+        return false;
+    }
+    if (options.config.first_sample < 0) {
+        std::cerr << "first sample can't be negative\n";
+        return false;
+    }
+    if (is_accumulation(options.output_path)) {
+        if (options.denoise) {
+            std::cerr << "--denoise needs the whole frame, denoise the merge instead\n";
+            return false;
+        }
+        options.config.noise_threshold = 0.0f;
+    }
+    return true;
+}
+
+// just enough for paths, ie quotes and windows separators
+std::string json_escape(const std::string& s) {
+    std::string escaped;
+    for (char c : s) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// fnv-1a of the scene file, camera included, so a checkpoint is only resumed
+// into the scene it was made from, and only .acc parts of one scene merge
+uint64_t hash_file(const std::string& path) {
+    uint64_t hash = 14695981039346656037ull;
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return hash;
+
+    unsigned char buffer[65536];
+    size_t count;
+    while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            hash = (hash ^ buffer[i]) * 1099511628211ull;
+        }
+    }
+    std::fclose(file);
+    return hash;
+}
+
+// weighted mean of the .acc files, which have to cover one unbroken run of passes
+// between them, so the result is the frame one render of that run would have made
+int merge_accumulations(const Options& options) {
+    std::vector<tools::Accumulation> parts(options.merge_paths.size());
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (!tools::read_accumulation(options.merge_paths[i], parts[i])) return 1;
+    }
+
+    std::sort(parts.begin(), parts.end(), [](const tools::Accumulation& a, const tools::Accumulation& b) {
+        return a.first_sample < b.first_sample;
+    });
+
+    // everything but the samples and pixels, which are summed below
+    tools::Accumulation merged = parts[0];
+    merged.samples = 0;
+    merged.pixels.clear();
+
+    for (const tools::Accumulation& part : parts) {
+        if (!tools::same_frame(part, merged)) {
+            std::cerr << "accumulations differ in scene, camera, size, seed or render settings, they aren't from one frame\n";
+            return 1;
+        }
+        const int expected = merged.first_sample + merged.samples;
+        if (part.first_sample != expected) {
+            std::cerr << "samples " << std::min(part.first_sample, expected) << " to "
+                << std::max(part.first_sample, expected) << (part.first_sample < expected ? " are in more than one accumulation\n" : " are missing\n");
+            return 1;
+        }
+        merged.samples += part.samples;
+    }
+
+    // in double, a few thousand float means summed straight would lose the low bits
+    std::vector<double> sum(parts[0].pixels.size(), 0.0);
+    for (const tools::Accumulation& part : parts) {
+        for (size_t i = 0; i < sum.size(); ++i) {
+            sum[i] += double(part.pixels[i]) * part.samples;
+        }
+    }
+    merged.pixels.resize(sum.size());
+    for (size_t i = 0; i < sum.size(); ++i) {
+        merged.pixels[i] = float(sum[i] / merged.samples);
+    }
+
+    const bool ok = is_accumulation(options.output_path)
+        ? tools::write_accumulation(options.output_path, merged)
+        : tools::write_image(options.output_path, merged.width, merged.height, merged.pixels);
+    if (!ok) return 1;
+
+    std::printf("{\"output\": \"%s\", \"width\": %d, \"height\": %d, \"first_sample\": %d, \"samples\": %d, \"parts\": %d}\n",
+        json_escape(options.output_path).c_str(), merged.width, merged.height,
+        merged.first_sample, merged.samples, int(parts.size()));
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_args(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+    if (options.merge) {
+        return merge_accumulations(options);
+    }
+
+    // == load ==
+    auto load_start = std::chrono::steady_clock::now();
+
+    Scene scene;
+    Camera camera;
+    if (!SceneSerialiser::load_scene(&scene, &camera, QString::fromStdString(options.scene_path))) {
+        std::cerr << "failed to load " << options.scene_path << "\n";
+        return 1;
+    }
+    okaytracer::RenderScene render_scene = okaytracer::RenderScene::from_scene(&scene);
+
+    const double load_ms = ms_since(load_start);
+
+    // == build ==
+    auto build_start = std::chrono::steady_clock::now();
+
+    okaytracer::Raytracer raytracer(options.threads);
+    raytracer.start_render(render_scene, camera, options.config);
+
+    const double build_ms = ms_since(build_start);
+
+    // == resume ==
+    const bool needs_hash = !options.checkpoint_path.empty() || is_accumulation(options.output_path);
+    const uint64_t scene_hash = needs_hash ? hash_file(options.scene_path) : 0;
+    int resumed_sample = 0;
+    if (!options.checkpoint_path.empty() && std::filesystem::exists(options.checkpoint_path)
+        && raytracer.resume_checkpoint(options.checkpoint_path, scene_hash)) {
+        resumed_sample = raytracer.get_current_sample();
+        std::cerr << "resumed from " << options.checkpoint_path << " at sample " << resumed_sample << "\n";
+    }
+
+    // == render ==
+    auto render_start = std::chrono::steady_clock::now();
+    auto last_checkpoint = render_start;
+
+    while (raytracer.is_rendering()) {
+        raytracer.render_one_sample();
+
+        if (!options.checkpoint_path.empty() && raytracer.is_rendering()
+            && ms_since(last_checkpoint) >= options.checkpoint_seconds * 1000.0) {
+            raytracer.save_checkpoint(options.checkpoint_path, scene_hash);
+            last_checkpoint = std::chrono::steady_clock::now();
+        }
+    }
+
+    const double render_ms = ms_since(render_start);
+
+    // == write ==
+    auto denoise_start = std::chrono::steady_clock::now();
+    const std::vector<float>& pixels = options.denoise ? raytracer.denoise() : raytracer.get_pixels();
+    const double denoise_ms = options.denoise ? ms_since(denoise_start) : 0.0;
+
+    auto write_start = std::chrono::steady_clock::now();
+    if (is_accumulation(options.output_path)) {
+        tools::Accumulation accumulation;
+        accumulation.width = options.config.width;
+        accumulation.height = options.config.height;
+        accumulation.first_sample = options.config.first_sample;
+        accumulation.samples = raytracer.get_current_sample();
+        accumulation.seed = options.config.seed;
+        accumulation.max_bounces = options.config.max_bounces;
+        accumulation.backend = int(options.config.backend);
+        accumulation.sampler = int(options.config.sampler);
+        accumulation.light_sampling = options.config.light_sampling;
+        accumulation.packet_primary_rays = options.config.packet_primary_rays;
+        accumulation.scene_hash = scene_hash;
+        const auto store = [](float* out, const Vec3& v) { out[0] = v.x; out[1] = v.y; out[2] = v.z; };
+        store(accumulation.camera_pos, camera.get_pos());
+        store(accumulation.camera_target, camera.get_target());
+        store(accumulation.camera_up, camera.get_up());
+        accumulation.camera_fov = camera.get_fov_degs();
+        accumulation.pixels = pixels;
+        if (!tools::write_accumulation(options.output_path, accumulation)) {
+            return 1;
+        }
+    }
+    else if (!tools::write_image(options.output_path, options.config.width, options.config.height, pixels)) {
+        return 1;
+    }
+    const double write_ms = ms_since(write_start);
+
+    // the image has everything it had, a finished render's checkpoint is no use
+    if (!options.checkpoint_path.empty()) {
+        std::error_code error;
+        std::filesystem::remove(options.checkpoint_path, error);
+    }
+
+    // one json object on stdout, everything human goes to stderr
+    std::printf(
+        "{\"scene\": \"%s\", \"output\": \"%s\", \"width\": %d, \"height\": %d, "
+        "\"first_sample\": %d, \"resumed_sample\": %d, \"samples\": %d, \"max_samples\": %d, \"threads\": %d, "
+        "\"load_ms\": %.3f, \"build_ms\": %.3f, \"render_ms\": %.3f, \"denoise_ms\": %.3f, \"write_ms\": %.3f}\n",
+        json_escape(options.scene_path).c_str(), json_escape(options.output_path).c_str(),
+        options.config.width, options.config.height,
+        options.config.first_sample, resumed_sample, raytracer.get_current_sample(), options.config.samples_per_pixel, raytracer.get_thread_count(),
+        load_ms, build_ms, render_ms, denoise_ms, write_ms);
+
+    return 0;
+}